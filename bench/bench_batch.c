@@ -0,0 +1,168 @@
+/**
+ * Benchmark of a lockstep batch against the same machines run one by one.
+ *
+ * Every lane gets its own seed and keys, and at the end the batch lanes are
+ * checked against the separately run machines.
+ *
+ * Usage: ./bench-batch [lanes] [path/to/game.ch8]
+ * Without a rom two built-in loops are run: one game-like, drawing and
+ * skipping on keys that differ by lane, and one of arithmetic on random
+ * registers that the lanes run in lockstep throughout.
+ */
+#include "../src/batch.h"
+#include "../src/chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The number of frames to run each lane for.
+#define BENCH_FRAMES 20000
+
+static const uint8_t benchRom[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x00, // 202: V1 = 0
+    0xC2, 0x0F, // 204: V2 = rand & 0x0F
+    0x72, 0x01, // 206: V2 += 1
+    0x83, 0x20, // 208: V3 = V2
+    0x83, 0x24, // 20A: V3 += V2
+    0x83, 0x06, // 20C: V3 = V0 >> 1
+    0x84, 0x35, // 20E: V4 -= V3
+    0x70, 0x01, // 210: V0 += 1
+    0xE2, 0x9E, // 212: Skip if key V2 pressed
+    0x12, 0x04, // 214: Jump to 204
+    0xA0, 0x50, // 216: I = 0x050 (font)
+    0xD0, 0x15, // 218: Draw 5 lines at V0, V1
+    0x12, 0x04, // 21A: Jump to 204
+};
+
+static const uint8_t lockstepRom[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0xC1, 0xFF, // 202: V1 = rand
+    0x80, 0x14, // 204: V0 += V1
+    0x82, 0x00, // 206: V2 = V0
+    0x82, 0x16, // 208: V2 = V1 >> 1
+    0x83, 0x25, // 20A: V3 -= V2
+    0x84, 0x3E, // 20C: V4 = V3 << 1
+    0x84, 0x13, // 20E: V4 ^= V1
+    0x74, 0x03, // 210: V4 += 3
+    0x34, 0x00, // 212: Skip if V4 == 0
+    0x71, 0x01, // 214: V1 += 1
+    0xA2, 0x00, // 216: I = 0x200
+    0xF4, 0x1E, // 218: I += V4
+    0x12, 0x04, // 21A: Jump to 204
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The keys for a lane in a frame, different for every lane.
+static uint16_t keysFor(int lane, int frame) {
+  return (uint16_t)((frame / 7 + lane) * 0x9E37) & (1 << (lane % 16));
+}
+
+/**
+ * Run a rom on lanes machines one by one and as a batch, and print both.
+ *
+ * Returns:
+ *  int: The number of lanes that didn't match, -1 if lanes is out of range.
+ */
+static int runRom(const char *name, const uint8_t *rom, size_t size,
+                  int lanes) {
+  Chip8Batch *batch = batchCreate(lanes);
+  if (batch == NULL) {
+    return -1;
+  }
+  Chip8 *machines[CHIP8_BATCH_MAX_LANES];
+  uint16_t keys[CHIP8_BATCH_MAX_LANES];
+
+  // One by one.
+  for (int lane = 0; lane < lanes; lane++) {
+    machines[lane] = chip8Create();
+    chip8LoadRom(machines[lane], rom, size);
+    chip8Seed(machines[lane], lane + 1);
+  }
+  double start = now();
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      chip8SetKeys(machines[lane], keysFor(lane, frame));
+      chip8RunFrame(machines[lane]);
+    }
+  }
+  double scalar = now() - start;
+
+  // Together.
+  batchLoadRom(batch, rom, size);
+  start = now();
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    for (int lane = 0; lane < lanes; lane++) {
+      keys[lane] = keysFor(lane, frame);
+    }
+    batchSetKeys(batch, keys);
+    batchRunFrame(batch);
+  }
+  double batched = now() - start;
+
+  int mismatches = 0;
+  for (int lane = 0; lane < lanes; lane++) {
+    Chip8 *sys = machines[lane];
+    int same = !memcmp(chip8GetFramebuffer(sys),
+                       batch->Machines[lane]->Display, DISPLAY_SIZE) &&
+               sys->PC == batch->PC[lane] && sys->I == batch->I[lane] &&
+               sys->Cycles == batch->Cycles[lane] &&
+               sys->DelayExpiry == batch->DelayExpiry[lane];
+    for (int x = 0; x < 16; x++) {
+      same &= sys->V[x] == batch->V[x][lane];
+    }
+    mismatches += !same;
+  }
+
+  double steps = (double)lanes * BENCH_FRAMES;
+  printf("%s: %i lanes, %i frames each\n", name, lanes, BENCH_FRAMES);
+  printf("one by one: %.3fs, %.2f M frames/s\n", scalar, steps / scalar / 1e6);
+  printf("batch:      %.3fs, %.2f M frames/s (%.1fx)\n", batched,
+         steps / batched / 1e6, scalar / batched);
+  printf("lockstep:   %.1f%% of lane cycles\n",
+         100.0 * batch->VectorCycles /
+             (batch->VectorCycles + batch->ScalarCycles));
+  printf("mismatched lanes: %i\n", mismatches);
+
+  for (int lane = 0; lane < lanes; lane++) {
+    chip8Destroy(machines[lane]);
+  }
+  batchDestroy(batch);
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  int lanes = argc > 1 ? atoi(argv[1]) : CHIP8_BATCH_MAX_LANES;
+  int mismatches;
+
+  if (argc > 2) {
+    uint8_t rom[4096 - 0x200];
+    FILE *fp = fopen(argv[2], "rb");
+    if (fp == NULL) {
+      printf("Couldn't load rom.\n");
+      exit(1);
+    }
+    size_t size = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+    mismatches = runRom(argv[2], rom, size, lanes);
+  } else {
+    mismatches = runRom("game", benchRom, sizeof(benchRom), lanes);
+    if (mismatches >= 0) {
+      printf("\n");
+      mismatches += runRom("lockstep", lockstepRom, sizeof(lockstepRom),
+                           lanes);
+    }
+  }
+  if (mismatches < 0) {
+    printf("Lanes must be 1 to %i.\n", CHIP8_BATCH_MAX_LANES);
+    exit(1);
+  }
+  return mismatches != 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * Benchmark of raw interpreter throughput.
+ *
+ * Built once normally and once with CHIP8_HARDENED (see the Makefile bench
+ * target) to show the cost of bounds checking every memory access.
+ *
+ * Usage: ./bench-core [path/to/game.ch8]
+ * Without a rom a built-in loop heavy on DXYN/FX33/FX55/FX65 is used.
+ */
+#include "../src/chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef CHIP8_HARDENED
+#define BENCH_LABEL "hardened"
+#else
+#define BENCH_LABEL "default"
+#endif
+
+// The number of frames to run.
+#define BENCH_FRAMES 2000000
+
+static const uint8_t benchRom[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x00, // 202: V1 = 0
+    0xA0, 0x50, // 204: I = 0x050 (font)
+    0xD0, 0x15, // 206: Draw 5 lines at V0, V1
+    0x70, 0x01, // 208: V0 += 1
+    0x71, 0x02, // 20A: V1 += 2
+    0xA4, 0x00, // 20C: I = 0x400
+    0xF0, 0x33, // 20E: BCD of V0 at I
+    0xF2, 0x55, // 210: Store V0 -> V2 at I
+    0xF2, 0x65, // 212: Load V0 -> V2 from I
+    0xE0, 0x9E, // 214: Skip if key V0 pressed
+    0x63, 0x00, // 216: V3 = 0
+    0x12, 0x04, // 218: Jump to 204
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  Chip8 *sys = chip8Create();
+
+  if (argc > 1) {
+    if (chip8LoadRomFile(sys, argv[1]) != 0) {
+      printf("Couldn't load rom.\n");
+      exit(1);
+    }
+  } else {
+    chip8LoadRom(sys, benchRom, sizeof(benchRom));
+  }
+
+  long cycles = 0;
+  int frame = 0;
+  double start = now();
+  for (; frame < BENCH_FRAMES && !chip8Halted(sys); frame++) {
+    cycles += chip8RunFrame(sys);
+  }
+  double elapsed = now() - start;
+
+  printf("%-8s: %ld cycles in %.3fs, %.1f M cycles/s (%.0fx real time)\n",
+         BENCH_LABEL, cycles, elapsed, cycles / elapsed / 1e6,
+         frame / 60.0 / elapsed);
+  if (chip8Fault(sys)) {
+    printf("%-8s: halted with fault %i\n", BENCH_LABEL, chip8Fault(sys));
+  }
+
+  chip8Destroy(sys);
+  return 0;
+}
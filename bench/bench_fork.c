@@ -0,0 +1,200 @@
+/**
+ * Benchmark of branching machines, as a search over inputs would.
+ *
+ * A beam search keeps up to BENCH_BEAM distinct states. Every generation each
+ * state is branched once per key, each branch runs a frame and is hashed, and
+ * the first BENCH_BEAM branches with new hashes become the next generation.
+ * This is run once keeping the states as forks and once keeping them as
+ * snapshots restored into a scratch machine, and the hashes of every branch
+ * are checked against each other. The memory held per state at the end is
+ * compared too.
+ *
+ * Usage: ./bench-fork [path/to/game.ch8]
+ */
+#include "../src/chip8.h"
+#include "../src/memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_BEAM 1024
+#define BENCH_GENERATIONS 200
+#define BENCH_KEYS 4
+
+// Size of the table used to find repeated states, a power of 2 well above
+// BENCH_BEAM * BENCH_KEYS.
+#define BENCH_TABLE_SIZE 16384
+
+#define BENCH_BRANCHES (BENCH_GENERATIONS * BENCH_BEAM * BENCH_KEYS)
+
+static const uint8_t benchRom[] = {
+    0xA0, 0x50, // 200: I = 0x050 (font)
+    0xD0, 0x15, // 202: Draw 5 lines at V0, V1
+    0x62, 0x00, // 204: V2 = 0
+    0xE2, 0xA1, // 206: Skip if key 0 not pressed
+    0x70, 0x01, // 208: V0 += 1
+    0x62, 0x01, // 20A: V2 = 1
+    0xE2, 0xA1, // 20C: Skip if key 1 not pressed
+    0x71, 0x01, // 20E: V1 += 1
+    0x62, 0x02, // 210: V2 = 2
+    0xE2, 0xA1, // 212: Skip if key 2 not pressed
+    0x73, 0x03, // 214: V3 += 3
+    0x84, 0x35, // 216: V4 -= V3
+    0xA4, 0x00, // 218: I = 0x400
+    0xF0, 0x33, // 21A: BCD of V0 at I
+    0xA6, 0x00, // 21C: I = 0x600
+    0xF4, 0x55, // 21E: Store V0 -> V4 at I
+    0x12, 0x00, // 220: Jump to 200
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Add a hash to the table, returning 1 if it wasn't there yet.
+static int addState(uint64_t *table, uint64_t hash) {
+  size_t slot = hash & (BENCH_TABLE_SIZE - 1);
+  while (table[slot] != 0 && table[slot] != hash) {
+    slot = (slot + 1) & (BENCH_TABLE_SIZE - 1);
+  }
+  int added = table[slot] == 0;
+  table[slot] = hash;
+  return added;
+}
+
+// The bytes held by a set of forks: each machine and its display plus each
+// distinct page.
+static size_t forkBytes(Chip8 **states, int count) {
+  static Chip8Page *pages[BENCH_BEAM * MEMORY_PAGE_COUNT];
+  int distinct = 0;
+
+  for (int state = 0; state < count; state++) {
+    for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+      Chip8Page *at = states[state]->Pages[page];
+      int seen = 0;
+      for (int i = 0; i < distinct && !seen; i++) {
+        seen = pages[i] == at;
+      }
+      if (!seen) {
+        pages[distinct++] = at;
+      }
+    }
+  }
+  return count * (sizeof(Chip8) + DISPLAY_SIZE) +
+         distinct * sizeof(Chip8Page);
+}
+
+// Run the search keeping forks if fork is set and otherwise snapshots.
+// Records the hash of every branch in hashes and the memory held per state
+// at the end, and returns the time taken.
+static double search(const uint8_t *rom, size_t size, int fork,
+                     uint64_t *hashes, long *branches, size_t *perState) {
+  static Chip8 *states[2][BENCH_BEAM];
+  static uint8_t *snapshots[2][BENCH_BEAM];
+  static uint64_t table[BENCH_TABLE_SIZE];
+  size_t snapshotSize = chip8SnapshotSize();
+  Chip8 *scratch = chip8Create();
+  int count = 1;
+
+  for (int i = 0; i < BENCH_BEAM; i++) {
+    snapshots[0][i] = malloc(snapshotSize);
+    snapshots[1][i] = malloc(snapshotSize);
+  }
+  chip8LoadRom(scratch, rom, size);
+  states[0][0] = chip8Fork(scratch);
+  chip8Snapshot(scratch, snapshots[0][0]);
+
+  double start = now();
+  *branches = 0;
+  for (int generation = 0; generation < BENCH_GENERATIONS; generation++) {
+    int from = generation & 1;
+    int next = 0;
+
+    memset(table, 0, sizeof(table));
+    for (int state = 0; state < count; state++) {
+      for (int key = 0; key < BENCH_KEYS; key++) {
+        Chip8 *child = scratch;
+        if (fork) {
+          child = chip8Fork(states[from][state]);
+        } else {
+          chip8Restore(scratch, snapshots[from][state]);
+        }
+        chip8SetKeys(child, 1 << key);
+        chip8RunFrame(child);
+
+        uint64_t hash = chip8Hash(child);
+        hashes[(*branches)++] = hash;
+        int keep = addState(table, hash) && next < BENCH_BEAM;
+        if (fork && keep) {
+          states[!from][next++] = child;
+        } else if (fork) {
+          chip8Destroy(child);
+        } else if (keep) {
+          chip8Snapshot(child, snapshots[!from][next++]);
+        }
+      }
+      if (fork) {
+        chip8Destroy(states[from][state]);
+      }
+    }
+    count = next;
+  }
+  double elapsed = now() - start;
+
+  *perState = fork ? forkBytes(states[BENCH_GENERATIONS & 1], count) / count
+                   : snapshotSize;
+  for (int state = 0; fork && state < count; state++) {
+    chip8Destroy(states[BENCH_GENERATIONS & 1][state]);
+  }
+  for (int i = 0; i < BENCH_BEAM; i++) {
+    free(snapshots[0][i]);
+    free(snapshots[1][i]);
+  }
+  chip8Destroy(scratch);
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  uint8_t rom[4096 - 0x200];
+  size_t size = sizeof(benchRom);
+
+  memcpy(rom, benchRom, size);
+  if (argc > 1) {
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+      printf("Couldn't load rom.\n");
+      exit(1);
+    }
+    size = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+  }
+
+  uint64_t *forked = malloc(BENCH_BRANCHES * sizeof(uint64_t));
+  uint64_t *copied = malloc(BENCH_BRANCHES * sizeof(uint64_t));
+  long forkBranches, copyBranches;
+  size_t forkSize, copySize;
+
+  double forking = search(rom, size, 1, forked, &forkBranches, &forkSize);
+  double copying = search(rom, size, 0, copied, &copyBranches, &copySize);
+
+  long mismatches = labs(forkBranches - copyBranches);
+  for (long branch = 0; branch < forkBranches && branch < copyBranches;
+       branch++) {
+    mismatches += forked[branch] != copied[branch];
+  }
+
+  printf("%ld branches, beam of %i\n", forkBranches, BENCH_BEAM);
+  printf("snapshots: %.3fs, %.2f M branches/s, %zu bytes per state\n",
+         copying, copyBranches / copying / 1e6, copySize);
+  printf("forks:     %.3fs, %.2f M branches/s, %zu bytes per state (%.1fx)\n",
+         forking, forkBranches / forking / 1e6, forkSize, copying / forking);
+  printf("mismatched branches: %ld\n", mismatches);
+
+  free(forked);
+  free(copied);
+  return mismatches != 0;
+}
@@ -0,0 +1,107 @@
+/**
+ * Benchmark of many machines stepped in turn, as a server running a game
+ * per player (or a search over many branches) would.
+ *
+ * Each round every machine runs a slice of BENCH_SLICE cycles, so with many
+ * machines each slice starts with the machine's state out of the cache. This
+ * is timed at 1, 64 and 1024 machines for the same total number of cycles;
+ * the drop in throughput as machines are added is the cost of switching
+ * between them.
+ *
+ * Usage: ./bench-roundrobin [path/to/game.ch8]
+ */
+#include "../src/chip8.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The cycles each machine runs per turn.
+#define BENCH_SLICE 4
+
+// The cycles run in total at each number of machines.
+#define BENCH_CYCLES 20000000
+
+static const int benchMachines[] = {1, 64, 1024};
+
+static const uint8_t benchRom[] = {
+    0x60, 0x00, // 200: V0 = 0
+    0x61, 0x00, // 202: V1 = 0
+    0xA0, 0x50, // 204: I = 0x050 (font)
+    0xD0, 0x15, // 206: Draw 5 lines at V0, V1
+    0x70, 0x01, // 208: V0 += 1
+    0x71, 0x02, // 20A: V1 += 2
+    0x22, 0x1C, // 20C: Call 21C
+    0xA4, 0x00, // 20E: I = 0x400
+    0xF0, 0x33, // 210: BCD of V0 at I
+    0xF2, 0x55, // 212: Store V0 -> V2 at I
+    0xE0, 0x9E, // 214: Skip if key V0 pressed
+    0x63, 0x00, // 216: V3 = 0
+    0x12, 0x04, // 218: Jump to 204
+    0x00, 0x00, // 21A: (unused)
+    0x84, 0x34, // 21C: V4 += V3
+    0x00, 0xEE, // 21E: Return
+};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Step count machines in turn until BENCH_CYCLES cycles have been run,
+// returning the time taken.
+static double roundRobin(const uint8_t *rom, size_t size, int count) {
+  Chip8 **machines = malloc(count * sizeof(Chip8 *));
+
+  for (int i = 0; i < count; i++) {
+    machines[i] = chip8Create();
+    chip8Seed(machines[i], i + 1);
+    chip8LoadRom(machines[i], rom, size);
+  }
+
+  long cycles = 0;
+  double start = now();
+  while (cycles < BENCH_CYCLES) {
+    for (int i = 0; i < count; i++) {
+      cycles += chip8Step(machines[i], BENCH_SLICE);
+    }
+  }
+  double elapsed = now() - start;
+
+  for (int i = 0; i < count; i++) {
+    chip8Destroy(machines[i]);
+  }
+  free(machines);
+  return elapsed;
+}
+
+int main(int argc, char **argv) {
+  uint8_t rom[4096 - 0x200];
+  size_t size = sizeof(benchRom);
+
+  memcpy(rom, benchRom, size);
+  if (argc > 1) {
+    FILE *fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+      printf("Couldn't load rom.\n");
+      exit(1);
+    }
+    size = fread(rom, 1, sizeof(rom), fp);
+    fclose(fp);
+  }
+
+  double single = 0;
+  for (size_t i = 0; i < sizeof(benchMachines) / sizeof(*benchMachines);
+       i++) {
+    double elapsed = roundRobin(rom, size, benchMachines[i]);
+    if (i == 0) {
+      single = elapsed;
+    }
+    printf("%5i machines: %.3fs, %.1f M cycles/s (%.2fx one machine)\n",
+           benchMachines[i], elapsed, BENCH_CYCLES / elapsed / 1e6,
+           single / elapsed);
+  }
+  return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * Benchmark of framebuffer streaming with many machines, each streamed to a
+ * client on a socketpair.
+ *
+ * Every frame each machine runs a frame and its stream sends what changed.
+ * Only streamFrame is timed. The clients' bytes are then decoded and checked
+ * against the machines' displays. This is run for roms that never change the
+ * display, change it every half second, change it every frame and change
+ * whole rows at once.
+ *
+ * Usage: ./bench-stream
+ */
+#include "../src/chip8.h"
+#include "../src/stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_STREAMS 1000
+#define BENCH_FRAMES 600
+
+// Draws once then spins.
+static const uint8_t idleRom[] = {
+    0xA0, 0x50, // 200: I = 0x050 (font)
+    0xD0, 0x15, // 202: Draw 5 lines at V0, V1
+    0x12, 0x04, // 204: Jump to 204
+};
+
+// Moves a sprite along every 30 frames.
+static const uint8_t slowRom[] = {
+    0xA0, 0x50, // 200: I = 0x050 (font)
+    0xD0, 0x15, // 202: Draw 5 lines at V0, V1
+    0x62, 0x1E, // 204: V2 = 30
+    0xF2, 0x15, // 206: Delay timer = V2
+    0xF3, 0x07, // 208: V3 = delay timer
+    0x33, 0x00, // 20A: Skip if V3 == 0
+    0x12, 0x08, // 20C: Jump to 208
+    0xD0, 0x15, // 20E: Erase the sprite
+    0x70, 0x01, // 210: V0 += 1
+    0x12, 0x02, // 212: Jump to 202
+};
+
+// Draws every few instructions.
+static const uint8_t busyRom[] = {
+    0xA0, 0x50, // 200: I = 0x050 (font)
+    0xD0, 0x15, // 202: Draw 5 lines at V0, V1
+    0x70, 0x01, // 204: V0 += 1
+    0x71, 0x02, // 206: V1 += 2
+    0x12, 0x00, // 208: Jump to 200
+};
+
+// Fills row 5 then clears it, waiting a frame after each so the whole row
+// changes at once.
+static const uint8_t fullRom[] = {
+    0x60, 0xFF, // 200: V0 = 0xFF
+    0xA3, 0x00, // 202: I = 0x300
+    0xF0, 0x55, // 204: Store V0 at I, a sprite row of 8 pixels
+    0xA3, 0x00, // 206: I = 0x300, the store moved it on
+    0x61, 0x00, // 208: V1 = 0
+    0x62, 0x05, // 20A: V2 = 5
+    0xD1, 0x21, // 20C: Draw 1 line at V1, V2
+    0x71, 0x08, // 20E: V1 += 8
+    0x31, 0x40, // 210: Skip if V1 == 64
+    0x12, 0x0C, // 212: Jump to 20C
+    0x22, 0x1C, // 214: Call 21C
+    0x00, 0xE0, // 216: Clear the display
+    0x22, 0x1C, // 218: Call 21C
+    0x12, 0x08, // 21A: Jump to 208
+    0x63, 0x01, // 21C: V3 = 1, wait a frame
+    0xF3, 0x15, // 21E: Delay timer = V3
+    0xF3, 0x07, // 220: V3 = delay timer
+    0x33, 0x00, // 222: Skip if V3 == 0
+    0x12, 0x20, // 224: Jump to 220
+    0x00, 0xEE, // 226: Return
+};
+
+typedef struct BenchClient {
+  int Fd;
+  uint64_t Rows[CHIP8_DISPLAY_HEIGHT];
+  uint8_t Pending[STREAM_BUFFER * 2];
+  size_t Used;
+  int HeaderRead;
+} BenchClient;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Decode one frame from data, returning its size or 0 if it isn't all there.
+static size_t decodeFrame(const uint8_t *data, size_t size, uint64_t *rows) {
+  if (size < 2) {
+    return 0;
+  }
+
+  uint64_t next[CHIP8_DISPLAY_HEIGHT];
+  memcpy(next, rows, sizeof(next));
+  if (data[0] == STREAM_KEY) {
+    memset(next, 0, sizeof(next));
+  }
+
+  size_t pos = 2;
+  for (int row = 0; row < data[1]; row++) {
+    if (pos + 2 > size) {
+      return 0;
+    }
+    int tag = data[pos++];
+    uint64_t changed = 0;
+    if (tag & STREAM_RLE) {
+      int count = data[pos++];
+      if (pos + count > size) {
+        return 0;
+      }
+      for (int run = 0, x = 0; run < count; x += data[pos + run], run++) {
+        for (int i = 0; run % 2 == 1 && i < data[pos + run]; i++) {
+          changed |= 1ull << (x + i);
+        }
+      }
+      pos += count;
+    } else {
+      if (pos + 8 > size) {
+        return 0;
+      }
+      for (int i = 0; i < 8; i++) {
+        changed |= (uint64_t)data[pos++] << (i * 8);
+      }
+    }
+    next[tag & ~STREAM_RLE] ^= changed;
+  }
+
+  memcpy(rows, next, sizeof(next));
+  return pos;
+}
+
+// Read and decode everything a client has been sent.
+static void readClient(BenchClient *client) {
+  ssize_t got;
+  while ((got = recv(client->Fd, client->Pending + client->Used,
+                     sizeof(client->Pending) - client->Used, MSG_DONTWAIT)) >
+         0) {
+    client->Used += got;
+  }
+
+  size_t pos = 0;
+  if (!client->HeaderRead && client->Used >= 8) {
+    client->HeaderRead = 1;
+    pos = 8;
+  }
+  size_t size;
+  while (client->HeaderRead &&
+         (size = decodeFrame(client->Pending + pos, client->Used - pos,
+                             client->Rows)) > 0) {
+    pos += size;
+  }
+  client->Used -= pos;
+  memmove(client->Pending, client->Pending + pos, client->Used);
+}
+
+// Whether a client's decoded frame matches a display.
+static int matches(const BenchClient *client, const uint8_t *display) {
+  for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+    for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+      if (((client->Rows[y] >> x) & 1) !=
+          display[y * CHIP8_DISPLAY_WIDTH + x]) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static void benchRom(const char *name, const uint8_t *rom, size_t size) {
+  Chip8 **machines = malloc(BENCH_STREAMS * sizeof(Chip8 *));
+  Chip8Stream **streams = malloc(BENCH_STREAMS * sizeof(Chip8Stream *));
+  BenchClient *clients = calloc(BENCH_STREAMS, sizeof(BenchClient));
+
+  for (int i = 0; i < BENCH_STREAMS; i++) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+      printf("Couldn't open %i socket pairs.\n", BENCH_STREAMS);
+      exit(1);
+    }
+    machines[i] = chip8Create();
+    chip8LoadRom(machines[i], rom, size);
+    streams[i] = streamCreate();
+    streamAttach(streams[i], pair[0]);
+    clients[i].Fd = pair[1];
+  }
+
+  double elapsed = 0;
+  long mismatches = 0;
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    for (int i = 0; i < BENCH_STREAMS; i++) {
+      chip8RunFrame(machines[i]);
+    }
+
+    double start = now();
+    for (int i = 0; i < BENCH_STREAMS; i++) {
+      streamFrame(streams[i], chip8GetFramebuffer(machines[i]));
+    }
+    elapsed += now() - start;
+
+    for (int i = 0; i < BENCH_STREAMS; i++) {
+      readClient(&clients[i]);
+      mismatches +=
+          !matches(&clients[i], chip8GetFramebuffer(machines[i]));
+    }
+  }
+
+  uint64_t bytes = 0;
+  uint64_t changed = 0;
+  for (int i = 0; i < BENCH_STREAMS; i++) {
+    bytes += streams[i]->Bytes;
+    changed += streams[i]->Changed;
+    streamDestroy(streams[i]);
+    chip8Destroy(machines[i]);
+    close(clients[i].Fd);
+  }
+  free(machines);
+  free(streams);
+  free(clients);
+
+  double streamFrames = (double)BENCH_STREAMS * BENCH_FRAMES;
+  printf("%-5s %.3fs, %.2fus a stream frame, %.1f bytes a frame, "
+         "%.1f%% changed, %li mismatched\n",
+         name, elapsed, elapsed / streamFrames * 1e6, bytes / streamFrames,
+         100 * changed / streamFrames, mismatches);
+}
+
+int main(void) {
+  printf("%i streams, %i frames\n", BENCH_STREAMS, BENCH_FRAMES);
+  benchRom("idle", idleRom, sizeof(idleRom));
+  benchRom("slow", slowRom, sizeof(slowRom));
+  benchRom("busy", busyRom, sizeof(busyRom));
+  benchRom("full", fullRom, sizeof(fullRom));
+  return 0;
+}
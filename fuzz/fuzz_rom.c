@@ -0,0 +1,66 @@
+/**
+ * In-process rom fuzzer for the interpreter core.
+ *
+ * Loads the input as a rom, then runs it for a bounded number of frames with
+ * the keys changing each frame so both sides of EX9E/EXA1/FX0A are reached.
+ * One machine is reused and reset between inputs, there is nothing else to
+ * set up so each execution costs about as much as the cycles it runs.
+ *
+ * Works with libFuzzer (build with -DFUZZ_LIBFUZZER -fsanitize=fuzzer) and
+ * AFL (persistent mode when built with afl-clang-fast, stdin otherwise).
+ */
+#include "../src/chip8.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// The number of frames to run each input for.
+#ifndef FUZZ_FRAMES
+#define FUZZ_FRAMES 64
+#endif
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  static Chip8 *sys = NULL;
+  if (sys == NULL) {
+    sys = chip8Create();
+  }
+
+  chip8Reset(sys);
+  if (chip8LoadRom(sys, data, size) != 0) {
+    return 0;
+  }
+
+  for (int frame = 0; frame < FUZZ_FRAMES && !chip8Halted(sys); frame++) {
+    // A cheap spread of key states, different every frame.
+    chip8SetKeys(sys, (uint16_t)(frame * 0x9E37));
+    chip8RunFrame(sys);
+  }
+  return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+#ifndef __AFL_LOOP
+#define __AFL_LOOP(count) (loops++ == 0)
+#endif
+
+int main(void) {
+  static uint8_t rom[4096];
+  int loops = 0;
+  (void)loops;
+
+  while (__AFL_LOOP(100000)) {
+    // Not stdio, its EOF would stick after the first input. AFL rewinds
+    // stdin before each one, so read it to the end again.
+    size_t size = 0;
+    ssize_t got;
+    while (size < sizeof(rom) &&
+           (got = read(0, rom + size, sizeof(rom) - size)) > 0) {
+      size += got;
+    }
+    LLVMFuzzerTestOneInput(rom, size);
+  }
+  return 0;
+}
+#endif
@@ -0,0 +1,227 @@
+/**
+ * Static rom analysis, see analysis.h.
+ *
+ * Code is found by following every path from the entry point (recursive
+ * traversal) so data between routines isn't mistaken for code. Writes are
+ * resolved by tracking I through each basic block from its ANNN.
+ */
+#include "analysis.h"
+#include "disasm.h"
+
+#include <string.h>
+
+// Each instruction pushes at most two addresses.
+#define WORKLIST_SIZE (2 * 4096 + 1)
+
+static uint16_t opcodeAt(const uint8_t *memory, uint16_t address) {
+  return (memory[address & 0xFFF] << 8) | memory[(address + 1) & 0xFFF];
+}
+
+/**
+ * Where control can go after an instruction, not counting the target of a
+ * call (which returns to the next instruction).
+ *
+ * Parameters:
+ *  uint16_t address: The address of the instruction.
+ *  uint16_t opcode: The instruction.
+ *  uint16_t* targets: Filled with up to 2 successors.
+ * Returns:
+ *  int: The number of successors, 0 for 00EE, BNNN and unknown opcodes
+ *       (which cycleSystem never moves past).
+ */
+int successors(uint16_t address, uint16_t opcode, uint16_t *targets) {
+  char text[32];
+
+  if (!disassemble(opcode, text, sizeof(text))) {
+    return 0;
+  }
+  switch (opcode & 0xF000) {
+  case 0x0000:
+    if (opcode == 0x00EE) {
+      return 0;
+    }
+    break;
+  case 0x1000:
+    targets[0] = opcode & 0x0FFF;
+    return 1;
+  case 0xB000:
+    return 0;
+  case 0x3000:
+  case 0x4000:
+  case 0x5000:
+  case 0x9000:
+  case 0xE000:
+    targets[0] = (address + 2) & 0xFFF;
+    targets[1] = (address + 4) & 0xFFF;
+    return 2;
+  }
+  targets[0] = (address + 2) & 0xFFF;
+  return 1;
+}
+
+/**
+ * Whether an instruction ends its basic block.
+ */
+static int endsBlock(uint16_t address, uint16_t opcode) {
+  uint16_t targets[2];
+  int count = successors(address, opcode, targets);
+
+  return (opcode & 0xF000) == 0x2000 || count != 1 ||
+         targets[0] != ((address + 2) & 0xFFF);
+}
+
+/**
+ * Find the last instruction of the basic block starting at leader.
+ */
+uint16_t blockEnd(const uint8_t *memory, const RomAnalysis *analysis,
+                  uint16_t leader) {
+  uint16_t address = leader;
+
+  while (!endsBlock(address, opcodeAt(memory, address))) {
+    uint16_t next = (address + 2) & 0xFFF;
+    if (analysis->Flags[next] & ANALYSIS_LEADER ||
+        !(analysis->Flags[next] & ANALYSIS_CODE)) {
+      break;
+    }
+    address = next;
+  }
+  return address;
+}
+
+/**
+ * Mark a write of count bytes from I by the instruction at address.
+ */
+static void markWrite(RomAnalysis *analysis, uint16_t address, int I,
+                      int count) {
+  if (I < 0) {
+    analysis->Flags[address] |= ANALYSIS_UNKNOWN_WRITE;
+    analysis->UnknownWrites++;
+    return;
+  }
+
+  int overwritesCode = 0;
+  for (int i = 0; i < count; i++) {
+    uint16_t at = (I + i) & 0xFFF;
+    analysis->Flags[at] |= ANALYSIS_WRITTEN;
+    overwritesCode |= analysis->Flags[at] & (ANALYSIS_CODE | ANALYSIS_OPERAND);
+  }
+  if (overwritesCode) {
+    analysis->Flags[address] |= ANALYSIS_SELF_MODIFY;
+    analysis->SelfModifying++;
+  }
+}
+
+/**
+ * Follow I through a basic block, marking what it points at and writes.
+ */
+static void analyseBlock(const uint8_t *memory, RomAnalysis *analysis,
+                         uint16_t leader) {
+  uint16_t end = blockEnd(memory, analysis, leader);
+  // -1 when not known.
+  int I = -1;
+
+  for (uint16_t address = leader;; address = (address + 2) & 0xFFF) {
+    uint16_t opcode = opcodeAt(memory, address);
+    int X = (opcode & 0x0F00) >> 8;
+
+    if ((opcode & 0xF000) == 0xA000) {
+      I = opcode & 0x0FFF;
+      analysis->Flags[I] |= ANALYSIS_DATA_REF;
+    } else if ((opcode & 0xF000) == 0xF000) {
+      switch (opcode & 0x00FF) {
+      case 0x33:
+        markWrite(analysis, address, I, 3);
+        break;
+      case 0x55:
+        markWrite(analysis, address, I, X + 1);
+        // FX55 and FX65 leave I one higher, as in cycleSystem.
+        I = I < 0 ? I : I + 1;
+        break;
+      case 0x65:
+        I = I < 0 ? I : I + 1;
+        break;
+      case 0x1E:
+      case 0x29:
+        I = -1;
+        break;
+      }
+    }
+
+    if (address == end) {
+      break;
+    }
+  }
+}
+
+/**
+ * Analyse the rom in memory.
+ *
+ * Parameters:
+ *  const uint8_t* memory: The full 4K memory image.
+ *  uint16_t entry: Where execution starts, 0x200.
+ *  RomAnalysis* analysis: Filled with the results.
+ */
+void analyseRom(const uint8_t *memory, uint16_t entry, RomAnalysis *analysis) {
+  uint16_t worklist[WORKLIST_SIZE];
+  int pending = 0;
+
+  memset(analysis, 0, sizeof(RomAnalysis));
+  worklist[pending++] = entry & 0xFFF;
+  analysis->Flags[entry & 0xFFF] |= ANALYSIS_LEADER;
+
+  while (pending > 0) {
+    uint16_t address = worklist[--pending];
+
+    // Decode straight line code until something branches.
+    while (!(analysis->Flags[address] & ANALYSIS_CODE)) {
+      uint16_t opcode = opcodeAt(memory, address);
+      uint16_t targets[2];
+      char text[32];
+
+      analysis->Flags[address] |= ANALYSIS_CODE;
+      analysis->Flags[(address + 1) & 0xFFF] |= ANALYSIS_OPERAND;
+      analysis->Instructions++;
+
+      if (!disassemble(opcode, text, sizeof(text))) {
+        analysis->Flags[address] |= ANALYSIS_HALT;
+        break;
+      }
+      if ((opcode & 0xF000) == 0xB000) {
+        analysis->Flags[address] |= ANALYSIS_INDIRECT;
+      }
+      if ((opcode & 0xF000) == 0x2000) {
+        uint16_t target = opcode & 0x0FFF;
+        analysis->Flags[target] |= ANALYSIS_CALL_TARGET | ANALYSIS_LEADER;
+        if (pending < WORKLIST_SIZE) {
+          worklist[pending++] = target;
+        }
+      }
+
+      int count = successors(address, opcode, targets);
+      if (!endsBlock(address, opcode)) {
+        address = targets[0];
+        continue;
+      }
+      for (int i = 0; i < count; i++) {
+        analysis->Flags[targets[i]] |= ANALYSIS_LEADER;
+        // A skip falls through to targets[0] and jumps to targets[1].
+        if ((opcode & 0xF000) == 0x1000 || i == 1) {
+          analysis->Flags[targets[i]] |= ANALYSIS_JUMP_TARGET;
+        }
+        if (pending < WORKLIST_SIZE) {
+          worklist[pending++] = targets[i];
+        }
+      }
+      break;
+    }
+  }
+
+  // Now the leaders are known, split into blocks and follow I through them.
+  for (int address = 0; address < 4096; address++) {
+    if ((analysis->Flags[address] & (ANALYSIS_LEADER | ANALYSIS_CODE)) ==
+        (ANALYSIS_LEADER | ANALYSIS_CODE)) {
+      analysis->Blocks++;
+      analyseBlock(memory, analysis, address);
+    }
+  }
+}
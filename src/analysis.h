@@ -0,0 +1,41 @@
+/**
+ * Static analysis of a rom image: which bytes are code, where the basic
+ * blocks start, what is called, what is data and which instructions may
+ * write over code.
+ */
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+
+// Per address flags.
+#define ANALYSIS_CODE 0x0001         // The first byte of an instruction.
+#define ANALYSIS_OPERAND 0x0002      // The second byte of an instruction.
+#define ANALYSIS_LEADER 0x0004       // The start of a basic block.
+#define ANALYSIS_JUMP_TARGET 0x0008  // Target of a 1NNN or a skip.
+#define ANALYSIS_CALL_TARGET 0x0010  // Target of a 2NNN.
+#define ANALYSIS_DATA_REF 0x0020     // Pointed at by ANNN.
+#define ANALYSIS_WRITTEN 0x0040      // Written by FX33/FX55.
+#define ANALYSIS_INDIRECT 0x0080     // BNNN, the targets aren't known.
+#define ANALYSIS_SELF_MODIFY 0x0100  // An FX33/FX55 that writes over code.
+#define ANALYSIS_UNKNOWN_WRITE 0x0200 // An FX33/FX55 with I not known.
+#define ANALYSIS_HALT 0x0400         // An opcode the interpreter doesn't know.
+
+typedef struct RomAnalysis {
+  uint16_t Flags[4096];
+
+  // The number of instructions found.
+  int Instructions;
+  // The number of basic blocks.
+  int Blocks;
+  // Instructions flagged ANALYSIS_SELF_MODIFY and ANALYSIS_UNKNOWN_WRITE.
+  int SelfModifying;
+  int UnknownWrites;
+} RomAnalysis;
+
+void analyseRom(const uint8_t *memory, uint16_t entry, RomAnalysis *analysis);
+uint16_t blockEnd(const uint8_t *memory, const RomAnalysis *analysis,
+                  uint16_t leader);
+int successors(uint16_t address, uint16_t opcode, uint16_t *targets);
+
+#endif
@@ -0,0 +1,654 @@
+/**
+ * Lockstep batches, see batch.h.
+ */
+#include "batch.h"
+#include "memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// 8-bit lane operations on whichever vector unit is available.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VEC_BYTES 32
+typedef __m256i Vec;
+static inline Vec vecLoad(const uint8_t *p) {
+  return _mm256_load_si256((const Vec *)p);
+}
+static inline void vecStore(uint8_t *p, Vec a) {
+  _mm256_store_si256((Vec *)p, a);
+}
+static inline Vec vecSet(uint8_t b) { return _mm256_set1_epi8((char)b); }
+static inline Vec vecAdd(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+static inline Vec vecSub(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+static inline Vec vecAddSat(Vec a, Vec b) { return _mm256_adds_epu8(a, b); }
+static inline Vec vecMin(Vec a, Vec b) { return _mm256_min_epu8(a, b); }
+static inline Vec vecEq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline Vec vecAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+static inline Vec vecOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+static inline Vec vecXor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+static inline Vec vecShr(Vec a, int n) {
+  return _mm256_and_si256(_mm256_srli_epi16(a, n), vecSet(0xFF >> n));
+}
+static inline Vec vecSelect(Vec mask, Vec a, Vec b) {
+  return _mm256_blendv_epi8(b, a, mask);
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC_BYTES 16
+typedef __m128i Vec;
+static inline Vec vecLoad(const uint8_t *p) {
+  return _mm_load_si128((const Vec *)p);
+}
+static inline void vecStore(uint8_t *p, Vec a) { _mm_store_si128((Vec *)p, a); }
+static inline Vec vecSet(uint8_t b) { return _mm_set1_epi8((char)b); }
+static inline Vec vecAdd(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+static inline Vec vecSub(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+static inline Vec vecAddSat(Vec a, Vec b) { return _mm_adds_epu8(a, b); }
+static inline Vec vecMin(Vec a, Vec b) { return _mm_min_epu8(a, b); }
+static inline Vec vecEq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline Vec vecAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+static inline Vec vecOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+static inline Vec vecXor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+static inline Vec vecShr(Vec a, int n) {
+  return _mm_and_si128(_mm_srli_epi16(a, n), vecSet(0xFF >> n));
+}
+static inline Vec vecSelect(Vec mask, Vec a, Vec b) {
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#else
+// Plain C fallback, written so the compiler can vectorise it itself.
+#define VEC_BYTES 16
+typedef struct Vec {
+  uint8_t b[VEC_BYTES];
+} Vec;
+#define VEC_MAP(expr)                                                          \
+  Vec r;                                                                       \
+  for (int i = 0; i < VEC_BYTES; i++) {                                        \
+    r.b[i] = (expr);                                                           \
+  }                                                                            \
+  return r;
+static inline Vec vecLoad(const uint8_t *p) { VEC_MAP(p[i]) }
+static inline void vecStore(uint8_t *p, Vec a) { memcpy(p, a.b, VEC_BYTES); }
+static inline Vec vecSet(uint8_t b) { VEC_MAP(b) }
+static inline Vec vecAdd(Vec a, Vec b) { VEC_MAP(a.b[i] + b.b[i]) }
+static inline Vec vecSub(Vec a, Vec b) { VEC_MAP(a.b[i] - b.b[i]) }
+static inline Vec vecAddSat(Vec a, Vec b) {
+  VEC_MAP(a.b[i] + b.b[i] > 0xFF ? 0xFF : a.b[i] + b.b[i])
+}
+static inline Vec vecMin(Vec a, Vec b) {
+  VEC_MAP(a.b[i] < b.b[i] ? a.b[i] : b.b[i])
+}
+static inline Vec vecEq(Vec a, Vec b) { VEC_MAP(a.b[i] == b.b[i] ? 0xFF : 0) }
+static inline Vec vecAnd(Vec a, Vec b) { VEC_MAP(a.b[i] & b.b[i]) }
+static inline Vec vecOr(Vec a, Vec b) { VEC_MAP(a.b[i] | b.b[i]) }
+static inline Vec vecXor(Vec a, Vec b) { VEC_MAP(a.b[i] ^ b.b[i]) }
+static inline Vec vecShr(Vec a, int n) { VEC_MAP(a.b[i] >> n) }
+static inline Vec vecSelect(Vec mask, Vec a, Vec b) {
+  VEC_MAP((mask.b[i] & a.b[i]) | (~mask.b[i] & b.b[i]))
+}
+#endif
+
+// Bit n set where values[n] == value, for the first width lanes (a multiple
+// of 16). And the reverse of that, byte n of mask is 0xFF where bit n of lanes
+// is.
+#if defined(__SSE2__)
+static inline uint32_t lanesEqual(const uint16_t *values, uint16_t value,
+                                  int width) {
+  __m128i match = _mm_set1_epi16(value);
+  uint32_t lanes = 0;
+  for (int o = 0; o < width; o += 16) {
+    __m128i low = _mm_load_si128((const __m128i *)(values + o));
+    __m128i high = _mm_load_si128((const __m128i *)(values + o + 8));
+    __m128i equal = _mm_packs_epi16(_mm_cmpeq_epi16(low, match),
+                                    _mm_cmpeq_epi16(high, match));
+    lanes |= (uint32_t)_mm_movemask_epi8(equal) << o;
+  }
+  return lanes;
+}
+
+static inline void expandMask(uint32_t lanes, uint8_t *mask, int width) {
+  __m128i bits = _mm_set_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16,
+                              8, 4, 2, 1);
+  for (int o = 0; o < width; o += 16) {
+    __m128i bytes = _mm_unpacklo_epi64(_mm_set1_epi8((char)(lanes >> o)),
+                                       _mm_set1_epi8((char)(lanes >> (o + 8))));
+    __m128i set = _mm_cmpeq_epi8(_mm_and_si128(bytes, bits), bits);
+    _mm_store_si128((__m128i *)(mask + o), set);
+  }
+}
+#else
+static inline uint32_t lanesEqual(const uint16_t *values, uint16_t value,
+                                  int width) {
+  uint32_t lanes = 0;
+  for (int lane = 0; lane < width; lane++) {
+    lanes |= (uint32_t)(values[lane] == value) << lane;
+  }
+  return lanes;
+}
+
+static inline void expandMask(uint32_t lanes, uint8_t *mask, int width) {
+  for (int lane = 0; lane < width; lane++) {
+    mask[lane] = (lanes >> lane & 1) ? 0xFF : 0;
+  }
+}
+#endif
+
+// 0xFF in each lane where a > b (unsigned).
+static inline Vec vecGreater(Vec a, Vec b) {
+  return vecXor(vecEq(vecMin(a, b), a), vecSet(0xFF));
+}
+
+// 1 in each lane where mask is set.
+static inline Vec vecFlag(Vec mask) { return vecAnd(mask, vecSet(1)); }
+
+// The lanes worth looking at in a batch: its lanes rounded up to whole
+// vectors, the rest are never used.
+#define LANE_WIDTH(batch) (((batch)->Lanes + VEC_BYTES - 1) & ~(VEC_BYTES - 1))
+
+// Loop over the first width lanes one vector at a time.
+#define FOR_EACH_VECTOR(offset, width)                                         \
+  for (int offset = 0; offset < (width); offset += VEC_BYTES)
+
+// Loop over the first width lanes, for per lane updates that the compiler can
+// vectorise (the group being run is picked out with a select on its mask).
+#define FOR_ALL_LANES(lane, width) for (int lane = 0; lane < (width); lane++)
+
+// Loop over the set bits (lanes) of a mask.
+#define FOR_EACH_LANE(lane, lanes)                                             \
+  for (uint32_t rest = (lanes), lane; rest && (lane = __builtin_ctz(rest), 1); \
+       rest &= rest - 1)
+
+/**
+ * Copy a lanes registers into its machine so cycleSystem can run it.
+ */
+static void exportLane(Chip8Batch *batch, int lane) {
+  Chip8 *sys = batch->Machines[lane];
+  for (int x = 0; x < 16; x++) {
+    sys->V[x] = batch->V[x][lane];
+  }
+  sys->I = batch->I[lane];
+  sys->PC = batch->PC[lane];
+  sys->Cycles = batch->Cycles[lane];
+  sys->DelayExpiry = batch->DelayExpiry[lane];
+  sys->RandomState = batch->RandomState[lane];
+}
+
+/**
+ * Copy a lanes registers back from its machine.
+ */
+static void importLane(Chip8Batch *batch, int lane) {
+  Chip8 *sys = batch->Machines[lane];
+  for (int x = 0; x < 16; x++) {
+    batch->V[x][lane] = sys->V[x];
+  }
+  batch->I[lane] = sys->I;
+  batch->PC[lane] = sys->PC;
+  batch->Cycles[lane] = sys->Cycles;
+  batch->DelayExpiry[lane] = sys->DelayExpiry;
+  batch->RandomState[lane] = sys->RandomState;
+  if (sys->Quit) {
+    batch->Halted |= 1u << lane;
+  }
+}
+
+/**
+ * Run one instruction (opcode) for one lane with cycleSystem.
+ */
+static void stepScalar(Chip8Batch *batch, int lane, uint16_t opcode) {
+  uint16_t I = batch->I[lane];
+  int written = 0;
+
+  exportLane(batch, lane);
+  cycleSystem(batch->Machines[lane]);
+  importLane(batch, lane);
+  batch->ScalarCycles++;
+
+  // Only FX33 and FX55 write to memory, both starting at the old I.
+  if ((opcode & 0xF0FF) == 0xF033) {
+    written = 3;
+  } else if ((opcode & 0xF0FF) == 0xF055) {
+    written = ((opcode & 0x0F00) >> 8) + 1;
+  }
+  for (int i = 0; i < written; i++) {
+    batch->Written[((I + i) & 0xFFF) >> 8] |= 1u << lane;
+  }
+}
+
+/**
+ * Run one instruction for every lane in mask at once, all at the same PC
+ * with the same opcode. Each case does exactly what cycleSystem does,
+ * including the order registers are written in (which matters when X or Y
+ * is F).
+ *
+ * Returns:
+ *  int: 1 if run, 0 if the instruction has to be run one lane at a time.
+ */
+static int stepVector(Chip8Batch *batch, uint16_t opcode,
+                      const uint8_t *mask) {
+  int width = LANE_WIDTH(batch);
+  int X = (opcode & 0x0F00) >> 8;
+  int Y = (opcode & 0x00F0) >> 4;
+  uint8_t NN = opcode & 0x00FF;
+  uint16_t NNN = opcode & 0x0FFF;
+  uint8_t *VX = batch->V[X];
+  uint8_t *VY = batch->V[Y];
+  uint8_t *VF = batch->V[0xF];
+  // The amount to skip by for 3XNN, 4XNN, 5XY0 and 9XY0 (0 or 0xFF).
+  uint8_t skip[CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+  int skips = 0;
+
+  switch (opcode & 0xF000) {
+  case 0x1000:
+    FOR_ALL_LANES(lane, width) {
+      batch->PC[lane] = mask[lane] ? NNN : batch->PC[lane];
+    }
+    return 1;
+
+  case 0x3000:
+  case 0x4000: {
+    Vec invert = vecSet((opcode & 0xF000) == 0x4000 ? 0xFF : 0);
+    FOR_EACH_VECTOR(o, width) {
+      vecStore(skip + o, vecXor(vecEq(vecLoad(VX + o), vecSet(NN)), invert));
+    }
+    skips = 1;
+    break;
+  }
+
+  case 0x5000:
+  case 0x9000: {
+    if (opcode & 0x000F) {
+      return 0;
+    }
+    Vec invert = vecSet((opcode & 0xF000) == 0x9000 ? 0xFF : 0);
+    FOR_EACH_VECTOR(o, width) {
+      Vec equal = vecEq(vecLoad(VX + o), vecLoad(VY + o));
+      vecStore(skip + o, vecXor(equal, invert));
+    }
+    skips = 1;
+    break;
+  }
+
+  case 0x6000:
+    FOR_EACH_VECTOR(o, width) {
+      Vec m = vecLoad(mask + o);
+      vecStore(VX + o, vecSelect(m, vecSet(NN), vecLoad(VX + o)));
+    }
+    break;
+
+  case 0x7000:
+    FOR_EACH_VECTOR(o, width) {
+      Vec m = vecLoad(mask + o);
+      Vec vx = vecLoad(VX + o);
+      vecStore(VX + o, vecSelect(m, vecAdd(vx, vecSet(NN)), vx));
+    }
+    break;
+
+  case 0x8000:
+    FOR_EACH_VECTOR(o, width) {
+      Vec m = vecLoad(mask + o);
+      Vec vx = vecLoad(VX + o);
+      Vec vy = vecLoad(VY + o);
+      Vec result, flag;
+
+      switch (opcode & 0x000F) {
+      case 0x0:
+        vecStore(VX + o, vecSelect(m, vy, vx));
+        continue;
+      case 0x1:
+        result = vecOr(vx, vy);
+        flag = vecSet(0);
+        break;
+      case 0x2:
+        result = vecAnd(vx, vy);
+        flag = vecSet(0);
+        break;
+      case 0x3:
+        result = vecXor(vx, vy);
+        flag = vecSet(0);
+        break;
+      case 0x4:
+        // Carry where the saturating sum differs from the wrapping one.
+        result = vecAdd(vx, vy);
+        flag = vecFlag(vecXor(vecEq(vecAddSat(vx, vy), result), vecSet(0xFF)));
+        // VF then VX.
+        vecStore(VF + o, vecSelect(m, flag, vecLoad(VF + o)));
+        vecStore(VX + o, vecSelect(m, result, vecLoad(VX + o)));
+        continue;
+      case 0x5:
+      case 0x7:
+        result = (opcode & 0x000F) == 0x5 ? vecSub(vx, vy) : vecSub(vy, vx);
+        vecStore(VX + o, vecSelect(m, result, vx));
+        // VF compares the registers after VX is written.
+        vx = vecLoad(VX + o);
+        vy = vecLoad(VY + o);
+        flag = vecFlag((opcode & 0x000F) == 0x5 ? vecGreater(vx, vy)
+                                                : vecGreater(vy, vx));
+        vecStore(VF + o, vecSelect(m, flag, vecLoad(VF + o)));
+        continue;
+      case 0x6:
+        result = vecShr(vy, 1);
+        flag = vecAnd(vy, vecSet(1));
+        break;
+      case 0xE:
+        result = vecAdd(vy, vy);
+        flag = vecShr(vy, 7);
+        break;
+      default:
+        return 0;
+      }
+      // VX then VF.
+      vecStore(VX + o, vecSelect(m, result, vx));
+      vecStore(VF + o, vecSelect(m, flag, vecLoad(VF + o)));
+    }
+    break;
+
+  case 0xA000:
+    FOR_ALL_LANES(lane, width) {
+      batch->I[lane] = mask[lane] ? NNN : batch->I[lane];
+    }
+    break;
+
+  case 0xB000:
+    FOR_ALL_LANES(lane, width) {
+      uint16_t target = batch->V[0][lane] + NNN;
+      batch->PC[lane] = mask[lane] ? target : batch->PC[lane];
+    }
+    return 1;
+
+  case 0xC000:
+    FOR_ALL_LANES(lane, width) {
+      uint32_t x = batch->RandomState[lane];
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
+      batch->RandomState[lane] = mask[lane] ? x : batch->RandomState[lane];
+      VX[lane] = mask[lane] ? (x >> 24) & NN : VX[lane];
+    }
+    break;
+
+  case 0xE000: {
+    // Key lookups are per lane but need no more than the keyboard. Out of
+    // range keys are left to cycleSystem (which wraps or faults them).
+    if (NN != 0x9E && NN != 0xA1) {
+      return 0;
+    }
+    uint8_t invert = NN == 0xA1;
+    FOR_ALL_LANES(lane, width) {
+      if (mask[lane] && VX[lane] > 0xF) {
+        return 0;
+      }
+    }
+    FOR_ALL_LANES(lane, width) {
+      skip[lane] = 0;
+      if (mask[lane]) {
+        uint8_t pressed = batch->Machines[lane]->Keyboard[VX[lane]] != 0;
+        skip[lane] = (pressed ^ invert) ? 0xFF : 0;
+      }
+    }
+    skips = 1;
+    break;
+  }
+
+  case 0xF000:
+    switch (NN) {
+    // The timers are worked out from each lanes cycle count (see readTimer
+    // and timerExpiry), which is 64 bit so isn't worth vectorising. FX18
+    // queues sound events in the machine so is left to cycleSystem.
+    case 0x07:
+      FOR_ALL_LANES(lane, width) {
+        uint64_t cycles = batch->Cycles[lane];
+        uint64_t expiry = batch->DelayExpiry[lane];
+        uint8_t timer = cycles >= expiry
+                            ? 0
+                            : expiry / CHIP8_CYCLES_PER_FRAME -
+                                  cycles / CHIP8_CYCLES_PER_FRAME;
+        VX[lane] = mask[lane] ? timer : VX[lane];
+      }
+      break;
+    case 0x15:
+      FOR_ALL_LANES(lane, width) {
+        uint64_t frame = batch->Cycles[lane] / CHIP8_CYCLES_PER_FRAME;
+        uint64_t expiry = (frame + VX[lane]) * CHIP8_CYCLES_PER_FRAME;
+        batch->DelayExpiry[lane] =
+            mask[lane] ? expiry : batch->DelayExpiry[lane];
+      }
+      break;
+    case 0x1E:
+      FOR_ALL_LANES(lane, width) {
+        batch->I[lane] += mask[lane] ? VX[lane] : 0;
+      }
+      break;
+    case 0x29:
+      FOR_ALL_LANES(lane, width) {
+        uint16_t font = 0x050 + VX[lane] * 5;
+        batch->I[lane] = mask[lane] ? font : batch->I[lane];
+      }
+      break;
+    default:
+      return 0;
+    }
+    break;
+
+  default:
+    return 0;
+  }
+
+  FOR_ALL_LANES(lane, width) {
+    uint16_t step = skips ? 2 + (skip[lane] & 2) : 2;
+    batch->PC[lane] += mask[lane] ? step : 0;
+  }
+  return 1;
+}
+
+// With CHIP8_HARDENED an opcode running past the end of memory faults instead
+// of wrapping (see FETCH_OPCODE in cpu.c), so is left to cycleSystem.
+#ifdef CHIP8_HARDENED
+#define FETCH_FAULTS(PC) ((PC) + 1 >= MEMORY_SIZE)
+#else
+#define FETCH_FAULTS(PC) 0
+#endif
+
+static uint16_t fetch(const Chip8Batch *batch, int lane) {
+  const Chip8 *sys = batch->Machines[lane];
+  uint16_t PC = batch->PC[lane];
+  return memoryFetch(sys, PC & 0xFFF);
+}
+
+/**
+ * Create a batch of lanes machines, each in its power-on state.
+ *
+ * Returns:
+ *  Chip8Batch*: The batch, NULL if lanes is out of range or out of memory.
+ */
+Chip8Batch *batchCreate(int lanes) {
+  if (lanes < 1 || lanes > CHIP8_BATCH_MAX_LANES) {
+    return NULL;
+  }
+
+  size_t size = (sizeof(Chip8Batch) + 31) & ~(size_t)31;
+  Chip8Batch *batch = aligned_alloc(32, size);
+  if (batch == NULL) {
+    return NULL;
+  }
+  memset(batch, 0, size);
+  batch->Lanes = lanes;
+
+  for (int lane = 0; lane < lanes; lane++) {
+    batch->Machines[lane] = systemInit();
+    if (batch->Machines[lane] == NULL) {
+      batch->Lanes = lane;
+      batchDestroy(batch);
+      return NULL;
+    }
+    importLane(batch, lane);
+  }
+  return batch;
+}
+
+/**
+ * Free a batch and its machines.
+ */
+void batchDestroy(Chip8Batch *batch) {
+  for (int lane = 0; lane < batch->Lanes; lane++) {
+    systemFree(batch->Machines[lane]);
+  }
+  free(batch);
+}
+
+/**
+ * Set the rom for every lane and reset them all to run it.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the rom is too large.
+ */
+int batchLoadRom(Chip8Batch *batch, const uint8_t *rom, size_t size) {
+  if (size > sizeof(batch->Rom)) {
+    return -1;
+  }
+  memcpy(batch->Rom, rom, size);
+  batch->RomSize = size;
+  batchReset(batch, 0xFFFFFFFF, NULL);
+  return 0;
+}
+
+/**
+ * Reset some lanes to their power-on state with the rom loaded.
+ *
+ * Parameters:
+ *  Chip8Batch* batch: The batch.
+ *  uint32_t lanes: Bit n set to reset lane n.
+ *  const uint32_t* seeds: The random seed for each lane, or NULL to seed
+ *                         lane n with n + 1.
+ */
+void batchReset(Chip8Batch *batch, uint32_t lanes, const uint32_t *seeds) {
+  for (int lane = 0; lane < batch->Lanes; lane++) {
+    if (!(lanes >> lane & 1)) {
+      continue;
+    }
+    Chip8 *sys = batch->Machines[lane];
+    systemReset(sys);
+    loadRomData(sys, batch->Rom, batch->RomSize);
+    seedRandom(sys, seeds ? seeds[lane] : (uint32_t)lane + 1);
+    batch->Halted &= ~(1u << lane);
+    for (int page = 0; page < 16; page++) {
+      batch->Written[page] &= ~(1u << lane);
+    }
+    importLane(batch, lane);
+  }
+}
+
+/**
+ * Set the keys of every lane, bit n of keys[lane] is key n.
+ */
+void batchSetKeys(Chip8Batch *batch, const uint16_t *keys) {
+  // Each nibble of keys as 4 bytes of Keyboard.
+  static const uint8_t nibbles[16][4] = {
+      {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0}, {1, 1, 0, 0},
+      {0, 0, 1, 0}, {1, 0, 1, 0}, {0, 1, 1, 0}, {1, 1, 1, 0},
+      {0, 0, 0, 1}, {1, 0, 0, 1}, {0, 1, 0, 1}, {1, 1, 0, 1},
+      {0, 0, 1, 1}, {1, 0, 1, 1}, {0, 1, 1, 1}, {1, 1, 1, 1}};
+
+  for (int lane = 0; lane < batch->Lanes; lane++) {
+    uint8_t *keyboard = batch->Machines[lane]->Keyboard;
+    for (int nibble = 0; nibble < 4; nibble++) {
+      memcpy(keyboard + nibble * 4, nibbles[(keys[lane] >> nibble * 4) & 0xF],
+             4);
+    }
+  }
+}
+
+/**
+ * Run cycles instructions on every lane that hasn't halted.
+ *
+ * Lanes are independent within a step, so they don't have to run their nth
+ * instructions together: each round the lanes at the same PC (and opcode) as
+ * the first lane with cycles left run together whatever their count, the
+ * others wait. Lanes that fall out of step (e.g. after a skip on different
+ * keys) join up again when the rest reach the PC they are waiting at. A
+ * group of one, or an instruction that can't be run together, is run one lane
+ * at a time. While every lane runs every round (lockstep) none can finish
+ * before the one with the fewest cycles left, so the lanes are only checked
+ * then.
+ */
+void batchStep(Chip8Batch *batch, int cycles) {
+  uint32_t all = batch->Lanes == 32 ? 0xFFFFFFFF : (1u << batch->Lanes) - 1;
+  uint32_t pending = all & ~batch->Halted;
+  int width = LANE_WIDTH(batch);
+  uint64_t target[CHIP8_BATCH_MAX_LANES];
+  // Lockstep rounds until a lane could be done, 0 when not in lockstep.
+  uint64_t steady = 0;
+
+  if (cycles <= 0) {
+    return;
+  }
+  FOR_ALL_LANES(lane, width) { target[lane] = batch->Cycles[lane] + cycles; }
+
+  while (pending) {
+    int lead = __builtin_ctz(pending);
+    uint16_t PC = batch->PC[lead];
+    uint16_t opcode = fetch(batch, lead);
+    uint8_t mask[CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+    uint32_t group = lanesEqual(batch->PC, PC, width) & pending;
+
+    // Lanes that have written to the page(s) the opcode is on may have
+    // different code there so check them, or all of them if the lead has.
+    uint32_t written = batch->Written[(PC & 0xFFF) >> 8] |
+                       batch->Written[((PC + 1) & 0xFFF) >> 8];
+    uint32_t check = (written >> lead & 1) ? group : group & written;
+    FOR_EACH_LANE(lane, check) {
+      if (fetch(batch, lane) != opcode) {
+        group &= ~(1u << lane);
+      }
+    }
+
+    int lockstep = group == pending;
+    if (lockstep && steady == 0) {
+      steady = UINT64_MAX;
+      FOR_EACH_LANE(lane, pending) {
+        uint64_t left = target[lane] - batch->Cycles[lane];
+        steady = left < steady ? left : steady;
+      }
+    }
+
+    expandMask(group, mask, width);
+    int count = __builtin_popcount(group);
+    if (count > 1 && !FETCH_FAULTS(PC) && stepVector(batch, opcode, mask)) {
+      batch->VectorCycles += count;
+      FOR_ALL_LANES(lane, width) { batch->Cycles[lane] += mask[lane] & 1; }
+    } else {
+      // cycleSystem counts the cycle, importLane copies it back.
+      FOR_EACH_LANE(lane, group) { stepScalar(batch, lane, opcode); }
+    }
+    pending &= ~batch->Halted;
+
+    if (lockstep && --steady > 0) {
+      continue;
+    }
+    FOR_EACH_LANE(lane, group) {
+      if (batch->Cycles[lane] == target[lane]) {
+        pending &= ~(1u << lane);
+      }
+    }
+    steady = 0;
+  }
+}
+
+/**
+ * Run one 60hz frame on every lane: CHIP8_CYCLES_PER_FRAME cycles, after
+ * which the timers have counted down once.
+ */
+void batchRunFrame(Chip8Batch *batch) {
+  batchStep(batch, CHIP8_CYCLES_PER_FRAME);
+}
+
+/**
+ * Copy every lanes display into frames, CHIP8_DISPLAY_WIDTH *
+ * CHIP8_DISPLAY_HEIGHT bytes per lane one after the other.
+ */
+void batchObserve(const Chip8Batch *batch, uint8_t *frames) {
+  size_t size = DISPLAY_SIZE;
+  for (int lane = 0; lane < batch->Lanes; lane++) {
+    memcpy(frames + lane * size, batch->Machines[lane]->Display, size);
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * Lockstep batches: many copies of one rom stepped together.
+ *
+ * The registers of every lane (machine) are stored structure-of-arrays so an
+ * instruction that all lanes are at can be run for every lane at once with
+ * SSE2 (or AVX2 when built with -mavx2). Memory, display, stack and keys stay
+ * in a Chip8 per lane; instructions that touch them, and lanes whose PC has
+ * diverged from the rest, are run one lane at a time with cycleSystem so the
+ * results always match running the machines separately. Lanes always use
+ * the uniform profile, one cycle per instruction.
+ */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+// The most lanes in a batch, one AVX2 register of 8-bit registers.
+#define CHIP8_BATCH_MAX_LANES 32
+
+typedef struct Chip8Batch {
+  int Lanes;
+
+  /**
+   * Registers by lane: V[x][lane] etc. Lanes past Lanes are never used.
+   */
+  uint8_t V[16][CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint16_t I[CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint16_t PC[CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint32_t RandomState[CHIP8_BATCH_MAX_LANES] __attribute__((aligned(32)));
+  uint64_t Cycles[CHIP8_BATCH_MAX_LANES];
+  uint64_t DelayExpiry[CHIP8_BATCH_MAX_LANES];
+
+  /**
+   * Machines: the rest of each lanes state. Only valid for registers while
+   * the lane is being run one at a time.
+   */
+  Chip8 *Machines[CHIP8_BATCH_MAX_LANES];
+
+  // Bit n is set once lane n has halted.
+  uint32_t Halted;
+
+  /**
+   * Written: bit n of Written[page] is set once lane n has written to that
+   * 256 byte page of memory. Lanes that haven't still have the rom there, so
+   * only lanes that have need their opcode checked to run together.
+   */
+  uint32_t Written[16];
+
+  // The rom loaded into every lane on reset.
+  uint8_t Rom[4096 - 0x200];
+  size_t RomSize;
+
+  // Lane cycles run together and one at a time, for tuning.
+  uint64_t VectorCycles;
+  uint64_t ScalarCycles;
+} Chip8Batch;
+
+Chip8Batch *batchCreate(int lanes);
+void batchDestroy(Chip8Batch *batch);
+int batchLoadRom(Chip8Batch *batch, const uint8_t *rom, size_t size);
+void batchReset(Chip8Batch *batch, uint32_t lanes, const uint32_t *seeds);
+void batchSetKeys(Chip8Batch *batch, const uint16_t *keys);
+void batchStep(Chip8Batch *batch, int cycles);
+void batchRunFrame(Chip8Batch *batch);
+void batchObserve(const Chip8Batch *batch, uint8_t *frames);
+
+#endif
@@ -0,0 +1,348 @@
+/**
+ * libchip8: thin wrappers over the cpu for use by embedders.
+ *
+ * See chip8.h for the overview.
+ */
+#include "chip8.h"
+#include "cpu.h"
+#include "memory.h"
+#include "trace.h"
+
+#include <stdlib.h> // for free
+#include <string.h> // for memcpy
+
+// "C8SS" little endian, followed by the version of the layout below.
+#define SNAPSHOT_MAGIC 0x53533843
+#define SNAPSHOT_VERSION 6
+
+// The fields that make up a snapshot, in the order they are stored after
+// MEMORY_SIZE bytes of memory.
+#define SNAPSHOT_FIELDS(X)                                                     \
+  X(V)                                                                         \
+  X(I)                                                                         \
+  X(PC)                                                                        \
+  X(Stack)                                                                     \
+  X(StackPointer)                                                              \
+  X(Cycles)                                                                    \
+  X(ProfileId)                                                                 \
+  X(DelayExpiry)                                                               \
+  X(SoundExpiry)                                                               \
+  X(SoundEnding)                                                               \
+  X(Keyboard)                                                                  \
+  X(RandomState)                                                               \
+  X(Quit)                                                                      \
+  X(Fault)
+
+#define FIELD_SIZE(field) sizeof(((Chip8 *)0)->field)
+
+// The arrays kept in their own allocation (see cpu.h) and their sizes, stored
+// after the fields.
+#define SNAPSHOT_ARRAYS(X) X(Display, DISPLAY_SIZE)
+
+/**
+ * Create a machine in its power-on state with no rom loaded.
+ *
+ * Returns:
+ *  Chip8*: The new machine or NULL if it couldn't be allocated.
+ */
+Chip8 *chip8Create(void) { return systemInit(); }
+
+/**
+ * Free a machine created by chip8Create.
+ */
+void chip8Destroy(Chip8 *sys) {
+  chip8TraceStop(sys);
+  systemFree(sys);
+}
+
+/**
+ * Create a copy of a machine for exploring another branch from the same
+ * state. Memory is shared page by page until one of the two writes to it, so
+ * forking costs the registers and display plus a reference to each page.
+ * The fork isn't traced; destroy it with chip8Destroy.
+ *
+ * Returns:
+ *  Chip8*: The fork or NULL if it couldn't be allocated.
+ */
+Chip8 *chip8Fork(Chip8 *sys) { return systemFork(sys); }
+
+/**
+ * Hash the full state of a machine (everything a snapshot holds), e.g. to
+ * find branches that have reached the same state. Machines in the same state
+ * have the same hash. Memory pages that haven't been written since they were
+ * last hashed, by this machine or a fork sharing them, aren't read again.
+ */
+uint64_t chip8Hash(Chip8 *sys) {
+  uint64_t hash = memoryHash(sys);
+#define HASH_FIELD(field)                                                      \
+  hash = hashBytes(hash, &sys->field, FIELD_SIZE(field));
+  SNAPSHOT_FIELDS(HASH_FIELD)
+#undef HASH_FIELD
+#define HASH_ARRAY(array, size) hash = hashBytes(hash, sys->array, size);
+  SNAPSHOT_ARRAYS(HASH_ARRAY)
+#undef HASH_ARRAY
+  return hash;
+}
+
+/**
+ * Put a machine back into its power-on state, the rom must be loaded again.
+ */
+void chip8Reset(Chip8 *sys) { systemReset(sys); }
+
+/**
+ * Seed the machines random number generator (used by CXNN).
+ */
+void chip8Seed(Chip8 *sys, uint32_t seed) { seedRandom(sys, seed); }
+
+/**
+ * Load a rom from a buffer.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the rom is larger than 0xE00 bytes.
+ */
+int chip8LoadRom(Chip8 *sys, const uint8_t *rom, size_t size) {
+  return loadRomData(sys, rom, size);
+}
+
+/**
+ * Load a rom from a file.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the file couldn't be opened.
+ */
+int chip8LoadRomFile(Chip8 *sys, const char *filePath) {
+  loadRom((char *)filePath, sys);
+  return sys->FileNotFound ? -1 : 0;
+}
+
+/**
+ * Run instructions until at least the given number of cycles have passed,
+ * stopping early if the machine halts. With the uniform profile that is one
+ * instruction a cycle, otherwise the last instruction may run over. The
+ * timers count down every chip8CyclesPerFrame cycles.
+ *
+ * Returns:
+ *  int: The number of cycles actually run.
+ */
+int chip8Step(Chip8 *sys, int cycles) {
+  int count = 0;
+  while (count < cycles && !sys->Quit) {
+    count += cycleSystem(sys);
+  }
+  return count;
+}
+
+/**
+ * Run to the end of the current 60hz frame, after which the timers have
+ * counted down once. An instruction that runs over the end of a frame
+ * shortens the next one, so frames stay in step with the timers.
+ *
+ * Returns:
+ *  int: The number of cycles actually run.
+ */
+int chip8RunFrame(Chip8 *sys) {
+  uint32_t period = sys->Profile->CyclesPerFrame;
+  uint64_t end = (sys->Cycles / period + 1) * period;
+  uint64_t start = sys->Cycles;
+
+  while (sys->Cycles < end && !sys->Quit) {
+    cycleSystem(sys);
+  }
+  return sys->Cycles - start;
+}
+
+/**
+ * Whether the machine has stopped (e.g. the stack overflowed).
+ */
+int chip8Halted(const Chip8 *sys) { return sys->Quit; }
+
+/**
+ * Why the machine halted itself, one of chip8Faults.
+ */
+int chip8Fault(const Chip8 *sys) { return sys->Fault; }
+
+/**
+ * Set how long each instruction takes, one of chip8Profiles. Pick the
+ * profile before running a rom, the clock isn't converted.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if profile isn't one of chip8Profiles.
+ */
+int chip8SetProfile(Chip8 *sys, int profile) {
+  return setProfile(sys, profile);
+}
+
+/**
+ * The number of cycles in one 60hz frame with the machines profile.
+ */
+uint32_t chip8CyclesPerFrame(const Chip8 *sys) {
+  return sys->Profile->CyclesPerFrame;
+}
+
+/**
+ * The number of cycles run since the machine was reset.
+ */
+uint64_t chip8Cycles(const Chip8 *sys) { return sys->Cycles; }
+
+/**
+ * The value of the delay timer now.
+ */
+uint8_t chip8DelayTimer(const Chip8 *sys) {
+  return readTimer(sys, sys->DelayExpiry);
+}
+
+/**
+ * The value of the sound timer now, the machine beeps while it is > 0.
+ */
+uint8_t chip8SoundTimer(const Chip8 *sys) {
+  return readTimer(sys, sys->SoundExpiry);
+}
+
+/**
+ * Take the oldest change to the beep not yet polled, with the cycle it
+ * happened on, so the host can start and stop a tone at the right point in
+ * the frame instead of checking the sound timer. Up to CHIP8_SOUND_EVENTS
+ * are kept, after which the oldest are dropped.
+ *
+ * Returns:
+ *  int: 1 if event was set, 0 if there are no more.
+ */
+int chip8PollSound(Chip8 *sys, Chip8SoundEvent *event) {
+  return pollSound(sys, event);
+}
+
+/**
+ * Get the display, CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT bytes row by
+ * row, each 1 or 0.
+ */
+const uint8_t *chip8GetFramebuffer(const Chip8 *sys) { return sys->Display; }
+
+/**
+ * Set the state of all 16 keys at once, bit n of keys is key n.
+ */
+void chip8SetKeys(Chip8 *sys, uint16_t keys) {
+  for (int key = 0; key < 16; key++) {
+    sys->Keyboard[key] = (keys >> key) & 1;
+  }
+}
+
+/**
+ * Start recording a binary trace of every instruction to a file (see
+ * trace.h), replacing any trace already running.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the file couldn't be opened.
+ */
+int chip8TraceStart(Chip8 *sys, const char *filePath) {
+  chip8TraceStop(sys);
+  sys->Trace = traceOpen(filePath);
+  return sys->Trace ? 0 : -1;
+}
+
+/**
+ * Stop recording the trace, if any, and flush it to its file.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if some of the trace couldn't be written.
+ */
+int chip8TraceStop(Chip8 *sys) {
+  int result = 0;
+  if (sys->Trace != NULL) {
+    result = traceClose(sys->Trace);
+    sys->Trace = NULL;
+  }
+  return result;
+}
+
+/**
+ * The number of bytes needed to hold a snapshot.
+ */
+size_t chip8SnapshotSize(void) {
+  size_t size = 2 * sizeof(uint32_t) + MEMORY_SIZE;
+#define ADD_SIZE(field) size += FIELD_SIZE(field);
+  SNAPSHOT_FIELDS(ADD_SIZE)
+#undef ADD_SIZE
+#define ADD_ARRAY_SIZE(array, arraySize) size += arraySize;
+  SNAPSHOT_ARRAYS(ADD_ARRAY_SIZE)
+#undef ADD_ARRAY_SIZE
+  return size;
+}
+
+/**
+ * Save the full state of a machine into buffer, which must be at least
+ * chip8SnapshotSize() bytes.
+ */
+void chip8Snapshot(const Chip8 *sys, void *buffer) {
+  uint8_t *out = buffer;
+  uint32_t header[2] = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION};
+
+  memcpy(out, header, sizeof(header));
+  out += sizeof(header);
+  memoryCopy(sys, out);
+  out += MEMORY_SIZE;
+#define SAVE_FIELD(field)                                                      \
+  memcpy(out, &sys->field, FIELD_SIZE(field));                                 \
+  out += FIELD_SIZE(field);
+  SNAPSHOT_FIELDS(SAVE_FIELD)
+#undef SAVE_FIELD
+#define SAVE_ARRAY(array, size)                                                \
+  memcpy(out, sys->array, size);                                               \
+  out += size;
+  SNAPSHOT_ARRAYS(SAVE_ARRAY)
+#undef SAVE_ARRAY
+}
+
+/**
+ * Restore a machine from a buffer written by chip8Snapshot.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the buffer isn't a snapshot of this version,
+ *       its profile isn't one of chip8Profiles or its stack pointer is past
+ *       the stack (sys is then left as it was).
+ */
+int chip8Restore(Chip8 *sys, const void *buffer) {
+  const uint8_t *in = buffer;
+  uint32_t header[2];
+
+  memcpy(header, in, sizeof(header));
+  if (header[0] != SNAPSHOT_MAGIC || header[1] != SNAPSHOT_VERSION) {
+    return -1;
+  }
+  in += sizeof(header);
+
+  // The profile is stored by ID and the stack pointer indexes Stack, check
+  // both before loading anything. setProfile leaves sys alone if the ID
+  // isn't a profile.
+  const uint8_t *field = in + MEMORY_SIZE;
+  int profileId = -1;
+  uint8_t stackPointer = STACK_DEPTH;
+#define FIND_CHECKED(name)                                                     \
+  if (offsetof(Chip8, name) == offsetof(Chip8, ProfileId)) {                   \
+    memcpy(&profileId, field, sizeof(profileId));                              \
+  } else if (offsetof(Chip8, name) == offsetof(Chip8, StackPointer)) {         \
+    memcpy(&stackPointer, field, sizeof(stackPointer));                        \
+  }                                                                            \
+  field += FIELD_SIZE(name);
+  SNAPSHOT_FIELDS(FIND_CHECKED)
+#undef FIND_CHECKED
+  if (stackPointer >= STACK_DEPTH || setProfile(sys, profileId) != 0) {
+    return -1;
+  }
+
+  memoryLoad(sys, 0, in, MEMORY_SIZE);
+  in += MEMORY_SIZE;
+#define LOAD_FIELD(field)                                                      \
+  memcpy(&sys->field, in, FIELD_SIZE(field));                                  \
+  in += FIELD_SIZE(field);
+  SNAPSHOT_FIELDS(LOAD_FIELD)
+#undef LOAD_FIELD
+#define LOAD_ARRAY(array, size)                                                \
+  memcpy(sys->array, in, size);                                                \
+  in += size;
+  SNAPSHOT_ARRAYS(LOAD_ARRAY)
+#undef LOAD_ARRAY
+  // Queued sound events were the old state's, as in systemReset.
+  sys->SoundEventHead = 0;
+  sys->SoundEventCount = 0;
+  return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * libchip8: the public interface for embedding the interpreter.
+ *
+ * Every function takes the machine it works on, there is no global state and
+ * nothing here depends on SDL, so any number of machines can be driven from
+ * any number of threads (one thread per machine at a time).
+ */
+#ifndef CHIP8_H
+#define CHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+
+// The number of cycles run per 60hz frame (one timer decrement) with the
+// uniform profile.
+#define CHIP8_CYCLES_PER_FRAME 10
+
+// The number of sound events a machine holds until they are polled.
+#define CHIP8_SOUND_EVENTS 16
+
+typedef struct Chip8 Chip8;
+
+// The beep starting or stopping, see chip8PollSound.
+typedef struct Chip8SoundEvent {
+  uint64_t Cycle; // When, in cycles run (see chip8Cycles).
+  int On;         // 1 if the beep started, 0 if it stopped.
+} Chip8SoundEvent;
+
+// How long each instruction takes, see chip8SetProfile.
+enum chip8Profiles {
+  CHIP8_PROFILE_UNIFORM, // Every instruction is 1 cycle, the default.
+  CHIP8_PROFILE_VIP      // The COSMAC VIP: timed in microseconds, DXYN waits
+                         // for the next frame.
+};
+
+// Why a machine halted itself, see chip8Fault.
+enum chip8Faults {
+  CHIP8_FAULT_NONE,
+  CHIP8_FAULT_STACK,  // 2NNN with a full stack or 00EE with an empty one.
+  CHIP8_FAULT_MEMORY, // Access outside of 4K memory (hardened builds only),
+                      // or no memory left to copy a page shared by a fork.
+  CHIP8_FAULT_KEY     // EX9E/EXA1 with VX > 0xF (hardened builds only).
+};
+
+Chip8 *chip8Create(void);
+void chip8Destroy(Chip8 *sys);
+Chip8 *chip8Fork(Chip8 *sys);
+uint64_t chip8Hash(Chip8 *sys);
+void chip8Reset(Chip8 *sys);
+void chip8Seed(Chip8 *sys, uint32_t seed);
+
+int chip8LoadRom(Chip8 *sys, const uint8_t *rom, size_t size);
+int chip8LoadRomFile(Chip8 *sys, const char *filePath);
+
+int chip8Step(Chip8 *sys, int cycles);
+int chip8RunFrame(Chip8 *sys);
+int chip8Halted(const Chip8 *sys);
+int chip8Fault(const Chip8 *sys);
+int chip8SetProfile(Chip8 *sys, int profile);
+uint32_t chip8CyclesPerFrame(const Chip8 *sys);
+uint64_t chip8Cycles(const Chip8 *sys);
+uint8_t chip8DelayTimer(const Chip8 *sys);
+uint8_t chip8SoundTimer(const Chip8 *sys);
+int chip8PollSound(Chip8 *sys, Chip8SoundEvent *event);
+
+const uint8_t *chip8GetFramebuffer(const Chip8 *sys);
+void chip8SetKeys(Chip8 *sys, uint16_t keys);
+
+int chip8TraceStart(Chip8 *sys, const char *filePath);
+int chip8TraceStop(Chip8 *sys);
+
+size_t chip8SnapshotSize(void);
+void chip8Snapshot(const Chip8 *sys, void *buffer);
+int chip8Restore(Chip8 *sys, const void *buffer);
+
+#endif
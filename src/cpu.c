@@ -8,13 +8,15 @@
  */
 #include "cpu.h"
 #include "logging.h"
+#include "memory.h"
+#include "trace.h"
 
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h> // for malloc
 #include <string.h> // for memset
 
-uint8_t font[] = {0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+static const uint8_t font[] = {0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
                   0x20, 0x60, 0x20, 0x20, 0x70, // 1
                   0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
                   0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
@@ -31,6 +33,160 @@ uint8_t font[] = {0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
                   0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
                   0xF0, 0x80, 0xF0, 0x80, 0x80};
 
+// Every access to Memory and Keyboard from an instruction goes through these.
+// By default addresses wrap at 4K (like the VIP) and key indexes at 16, which
+// keeps the interpreter memory safe for the cost of a mask. With
+// CHIP8_HARDENED every access is bounds checked instead and an out of range
+// access faults the machine, so bad roms are reported rather than absorbed.
+#ifdef CHIP8_HARDENED
+#define READ_MEMORY(sys, address) readMemoryChecked(sys, address)
+#define WRITE_MEMORY(sys, address, value)                                      \
+  writeMemoryChecked(sys, address, value)
+#define READ_KEY(sys, key) readKeyChecked(sys, key)
+#define FETCH_OPCODE(sys, address) fetchOpcodeChecked(sys, address)
+#else
+#define READ_MEMORY(sys, address) memoryRead(sys, (address) & 0xFFF)
+#define WRITE_MEMORY(sys, address, value)                                      \
+  memoryWrite(sys, (address) & 0xFFF, value)
+#define READ_KEY(sys, key) ((sys)->Keyboard[(key) & 0xF])
+#define FETCH_OPCODE(sys, address) memoryFetch(sys, (address) & 0xFFF)
+#endif
+
+/**
+ * Stop the system because of a fault, the first fault is the one kept.
+ *
+ * Parameters:
+ *  Chip8* sys: The system state.
+ *  int fault: One of chip8Faults.
+ */
+void raiseFault(Chip8 *sys, int fault) {
+  if (!sys->Fault) {
+    sys->Fault = fault;
+  }
+  sys->Quit = 1;
+}
+
+#ifdef CHIP8_HARDENED
+static uint8_t readMemoryChecked(Chip8 *sys, unsigned address) {
+  if (address >= MEMORY_SIZE) {
+    raiseFault(sys, CHIP8_FAULT_MEMORY);
+    return 0;
+  }
+  return memoryRead(sys, address);
+}
+
+static void writeMemoryChecked(Chip8 *sys, unsigned address, uint8_t value) {
+  if (address >= MEMORY_SIZE) {
+    raiseFault(sys, CHIP8_FAULT_MEMORY);
+    return;
+  }
+  memoryWrite(sys, address, value);
+}
+
+static uint16_t fetchOpcodeChecked(Chip8 *sys, unsigned address) {
+  if (address + 1 >= MEMORY_SIZE) {
+    raiseFault(sys, CHIP8_FAULT_MEMORY);
+    return 0;
+  }
+  return memoryFetch(sys, address);
+}
+
+static uint8_t readKeyChecked(Chip8 *sys, unsigned key) {
+  if (key >= sizeof(sys->Keyboard)) {
+    raiseFault(sys, CHIP8_FAULT_KEY);
+    return 0;
+  }
+  return sys->Keyboard[key];
+}
+#endif
+
+/**
+ * The cost of each kind of instruction by profile: X(kind, uniform, VIP).
+ *
+ * The VIP costs are microseconds (so 1e6 / 60 a frame) rounded from
+ * measurements of its interpreter. Draws and stores vary with the data, their
+ * per row and per register costs are approximate.
+ */
+#define PROFILE_COSTS(X)                                                       \
+  X(CLEAR, 1, 109)                                                             \
+  X(RETURN, 1, 105)                                                            \
+  X(JUMP, 1, 105)                                                              \
+  X(CALL, 1, 105)                                                              \
+  X(SKIP, 1, 46)                                                               \
+  X(SKIP_REGISTERS, 1, 73)                                                     \
+  X(SET, 1, 27)                                                                \
+  X(ADD, 1, 45)                                                                \
+  X(ALU, 1, 200)                                                               \
+  X(INDEX, 1, 55)                                                              \
+  X(JUMP_OFFSET, 1, 105)                                                       \
+  X(RANDOM, 1, 164)                                                            \
+  X(DRAW, 1, 2000)                                                             \
+  X(DRAW_ROW, 0, 500)                                                          \
+  X(KEY, 1, 73)                                                                \
+  X(TIMER, 1, 45)                                                              \
+  X(WAIT_KEY, 1, 45)                                                           \
+  X(ADD_INDEX, 1, 86)                                                          \
+  X(FONT, 1, 91)                                                               \
+  X(DIGITS, 1, 927)                                                            \
+  X(STORE, 1, 605)                                                             \
+  X(STORE_REGISTER, 0, 64)                                                     \
+  X(UNKNOWN, 1, 105)
+
+#define UNIFORM_COST(kind, uniform, vip) [COST_##kind] = uniform,
+#define VIP_COST(kind, uniform, vip) [COST_##kind] = vip,
+
+/**
+ * The profiles, by chip8Profiles. Machines point at these rather than
+ * holding a copy so the costs stay in the cache however many machines run.
+ */
+static const Chip8Profile profiles[] = {
+    [CHIP8_PROFILE_UNIFORM] = {{PROFILE_COSTS(UNIFORM_COST)},
+                               CHIP8_CYCLES_PER_FRAME, 0},
+    [CHIP8_PROFILE_VIP] = {{PROFILE_COSTS(VIP_COST)}, 16667, 1},
+};
+
+#undef UNIFORM_COST
+#undef VIP_COST
+
+/**
+ * Set how long each instruction takes. The clock isn't converted, so this
+ * should be done before running a rom.
+ *
+ * Parameters:
+ *  Chip8* sys: The system.
+ *  int profile: One of chip8Profiles.
+ * Returns:
+ *  int: 0 on success, -1 if profile isn't one of chip8Profiles.
+ */
+int setProfile(Chip8 *sys, int profile) {
+  if (profile < 0 || profile >= (int)(sizeof(profiles) / sizeof(*profiles))) {
+    return -1;
+  }
+  sys->Profile = &profiles[profile];
+  sys->ProfileId = profile;
+  return 0;
+}
+
+// The fields most instructions touch must fit in the first cache line.
+_Static_assert(offsetof(Chip8, Stack) == CACHE_LINE_SIZE,
+               "Chip8 hot fields don't fit in one cache line");
+
+/**
+ * Allocate a system without its memory pages, see the layout in cpu.h. The
+ * display is in the same block, straight after the struct.
+ *
+ * Returns:
+ *  Chip8* The system with its Display set, or NULL.
+ */
+static Chip8 *allocateSystem(void) {
+  Chip8 *sys = aligned_alloc(CACHE_LINE_SIZE, sizeof(Chip8) + DISPLAY_SIZE);
+  if (sys == NULL) {
+    return NULL;
+  }
+  sys->Display = (uint8_t *)(sys + 1);
+  return sys;
+}
+
 /**
  * Create a new system and initialise it.
  *
@@ -38,8 +194,64 @@ uint8_t font[] = {0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
  *  Chip* A pointer to the initialised system.
  */
 Chip8 *systemInit() {
-  Chip8 *sys = malloc(sizeof(Chip8));
+  Chip8 *sys = allocateSystem();
+  if (sys == NULL) {
+    return NULL;
+  }
+  if (memoryInit(sys) != 0) {
+    free(sys);
+    return NULL;
+  }
+
+  systemReset(sys);
+  setProfile(sys, CHIP8_PROFILE_UNIFORM);
+  sys->Trace = NULL;
+
+  simpleLog(WARN, "Created a new Chip8 instance.\n");
+  return sys;
+}
 
+/**
+ * Create a copy of a system that shares its memory pages, see memory.h. The
+ * copy doesn't inherit the trace.
+ *
+ * Parameters:
+ *  Chip8* sys: The system to fork, its pages become shared too.
+ * Returns:
+ *  Chip8* The fork or NULL if it couldn't be allocated.
+ */
+Chip8 *systemFork(Chip8 *sys) {
+  Chip8 *fork = allocateSystem();
+  if (fork == NULL) {
+    return NULL;
+  }
+
+  uint8_t *display = fork->Display;
+  memcpy(fork, sys, sizeof(Chip8));
+  fork->Display = display;
+  memcpy(fork->Display, sys->Display, DISPLAY_SIZE);
+  memoryFork(fork, sys);
+  fork->Trace = NULL;
+  return fork;
+}
+
+/**
+ * Free a system created by systemInit or systemFork. Any trace must have
+ * been closed already.
+ */
+void systemFree(Chip8 *sys) {
+  memoryFree(sys);
+  free(sys);
+}
+
+/**
+ * Put an existing system back into its power-on state. The rom (if any) is
+ * cleared along with the rest of memory.
+ *
+ * Parameters:
+ *  Chip8* sys: The system to reset.
+ */
+void systemReset(Chip8 *sys) {
   // Initialise V0 -> VF to 0.
   memset(sys->V, 0, sizeof(sys->V));
 
@@ -56,35 +268,210 @@ Chip8 *systemInit() {
   sys->StackPointer = 0;
 
   // Set the memory to 0 for now
-  memset(sys->Memory, 0, sizeof(sys->Memory));
+  memoryClear(sys);
 
   // Put the font in memory
   // Between 0x050->0x09F
-  for (int i = 0; i < 80; i++) {
-    sys->Memory[0x050 + i] = font[i];
-  }
+  memoryLoad(sys, 0x050, font, sizeof(font));
 
   // Set the display to blank
-  memset(sys->Display, 0, sizeof(sys->Display));
+  memset(sys->Display, 0, DISPLAY_SIZE);
 
-  // Set the timers
-  sys->DelayTimer = 0;
-  sys->SoundTimer = 0;
+  // Set the clock and timers
+  sys->Cycles = 0;
+  sys->DelayExpiry = 0;
+  sys->SoundExpiry = 0;
+  sys->SoundEventHead = 0;
+  sys->SoundEventCount = 0;
+  sys->SoundEnding = 0;
+
+  // No keys pressed.
+  memset(sys->Keyboard, 0, sizeof(sys->Keyboard));
+
+  seedRandom(sys, 1);
 
   sys->Quit = 0;
+  sys->Fault = CHIP8_FAULT_NONE;
   sys->FileNotFound = 0;
+}
 
-  simpleLog(WARN, "Created a new Chip8 instance.\n");
-  return sys;
+/**
+ * Seed the random number generator used by CXNN.
+ *
+ * Parameters:
+ *  Chip8* sys: The system state.
+ *  uint32_t seed: The seed, 0 is replaced by 1 as xorshift can't leave 0.
+ */
+void seedRandom(Chip8 *sys, uint32_t seed) {
+  sys->RandomState = seed ? seed : 1;
 }
 
 /**
- * Make one cycle of the fetch-decode-execute cycle.
+ * Get the next random byte from the systems xorshift32 generator.
  */
-void cycleSystem(Chip8 *sys) {
+static uint8_t nextRandom(Chip8 *sys) {
+  uint32_t x = sys->RandomState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  sys->RandomState = x;
+  return x >> 24;
+}
+
+/**
+ * Read a timer.
+ *
+ * Parameters:
+ *  const Chip8* sys: The system.
+ *  uint64_t expiry: The cycle the timer reaches 0 at.
+ * Returns:
+ *  uint8_t: The value of the timer now.
+ */
+uint8_t readTimer(const Chip8 *sys, uint64_t expiry) {
+  uint32_t period = sys->Profile->CyclesPerFrame;
+
+  if (sys->Cycles >= expiry) {
+    return 0;
+  }
+  return expiry / period - sys->Cycles / period;
+}
+
+/**
+ * Work out when a timer set to value now reaches 0. Timers count down at
+ * the end of every frame (CyclesPerFrame cycles of the systems profile).
+ *
+ * Parameters:
+ *  const Chip8* sys: The system.
+ *  uint8_t value: The value the timer is set to.
+ * Returns:
+ *  uint64_t: The cycle the timer reaches 0 at.
+ */
+uint64_t timerExpiry(const Chip8 *sys, uint8_t value) {
+  uint32_t period = sys->Profile->CyclesPerFrame;
+
+  return (sys->Cycles / period + value) * period;
+}
+
+/**
+ * Queue a sound event, dropping the oldest if the queue is full.
+ */
+static void pushSoundEvent(Chip8 *sys, uint64_t cycle, int on) {
+  if (sys->SoundEventCount == CHIP8_SOUND_EVENTS) {
+    sys->SoundEventHead = (sys->SoundEventHead + 1) % CHIP8_SOUND_EVENTS;
+    sys->SoundEventCount--;
+  }
+  int tail = (sys->SoundEventHead + sys->SoundEventCount) % CHIP8_SOUND_EVENTS;
+  sys->SoundEvents[tail].Cycle = cycle;
+  sys->SoundEvents[tail].On = on;
+  sys->SoundEventCount++;
+}
+
+/**
+ * Set the sound timer (FX18), queueing events for the beep starting or
+ * stopping.
+ */
+static void setSoundTimer(Chip8 *sys, uint8_t value) {
+  uint64_t expiry = timerExpiry(sys, value);
+  int sounding = sys->Cycles < sys->SoundExpiry;
+
+  if (!sounding && value > 0) {
+    // The last beep ended on its own, it hasn't been queued yet.
+    if (sys->SoundEnding) {
+      pushSoundEvent(sys, sys->SoundExpiry, 0);
+    }
+    pushSoundEvent(sys, sys->Cycles, 1);
+    sys->SoundEnding = 1;
+  } else if (sounding && value == 0) {
+    pushSoundEvent(sys, sys->Cycles, 0);
+    sys->SoundEnding = 0;
+  }
+  sys->SoundExpiry = expiry;
+}
+
+/**
+ * Take the oldest change to the beep.
+ *
+ * Parameters:
+ *  Chip8* sys: The system.
+ *  Chip8SoundEvent* event: Set to the event, if there is one.
+ * Returns:
+ *  int: 1 if there was an event, 0 if not.
+ */
+int pollSound(Chip8 *sys, Chip8SoundEvent *event) {
+  if (sys->SoundEnding && sys->Cycles >= sys->SoundExpiry) {
+    pushSoundEvent(sys, sys->SoundExpiry, 0);
+    sys->SoundEnding = 0;
+  }
+  if (sys->SoundEventCount == 0) {
+    return 0;
+  }
+  *event = sys->SoundEvents[sys->SoundEventHead];
+  sys->SoundEventHead = (sys->SoundEventHead + 1) % CHIP8_SOUND_EVENTS;
+  sys->SoundEventCount--;
+  return 1;
+}
+
+/**
+ * Write bytes to memory starting at an address, for FX33 and FX55. These
+ * are kept out of line (and called last) so that the rare copy of a shared
+ * page (see memory.h) doesn't cost executeInstruction registers on every
+ * other instruction.
+ *
+ * Parameters:
+ *  Chip8* sys: The system to write to.
+ *  unsigned address: The first address, each byte wraps as WRITE_MEMORY.
+ *  const uint8_t* bytes: The bytes to write.
+ *  int count: The number of bytes.
+ */
+__attribute__((noinline)) static void storeBytes(Chip8 *sys, unsigned address,
+                                                 const uint8_t *bytes,
+                                                 int count) {
+  for (int i = 0; i < count; i++) {
+    WRITE_MEMORY(sys, address + i, bytes[i]);
+  }
+}
+
+/**
+ * Write the hundreds, tens and ones digits of value to memory, for FX33.
+ */
+__attribute__((noinline)) static void storeDigits(Chip8 *sys,
+                                                  unsigned address,
+                                                  uint8_t value) {
+  uint8_t digits[3] = {value / 100, (value / 10) % 10, value % 10};
+  storeBytes(sys, address, digits, sizeof(digits));
+}
+
+// The cost of a kind of instruction in the systems profile.
+#define COST(kind) (sys->Profile->Costs[COST_##kind])
+
+/**
+ * The cost of DXYN drawing rows rows. With DisplayWait the draw first waits
+ * for the start of the next frame, as the VIP does for its vertical blank
+ * interrupt, so at most one sprite is drawn a frame.
+ */
+__attribute__((noinline)) static unsigned drawCost(const Chip8 *sys,
+                                                  int rows) {
+  const Chip8Profile *profile = sys->Profile;
+  unsigned cost = COST(DRAW) + rows * COST(DRAW_ROW);
+
+  if (profile->DisplayWait) {
+    uint32_t period = profile->CyclesPerFrame;
+    cost += (period - sys->Cycles % period) % period;
+  }
+  return cost;
+}
+
+/**
+ * Fetch, decode and execute the instruction at PC.
+ *
+ * Returns:
+ *  unsigned: The cycles the instruction took in the systems profile.
+ */
+static inline unsigned executeInstruction(Chip8 *sys) {
+  unsigned cost;
 
   // Fetch the operation from memory, 16 bit made up from two memory locations.
-  uint16_t opcode = (sys->Memory[sys->PC] << 8) | sys->Memory[sys->PC + 1];
+  uint16_t opcode = FETCH_OPCODE(sys, sys->PC);
 
   // Increment the PC.
   // sys->PC += 2;
@@ -98,12 +485,20 @@ void cycleSystem(Chip8 *sys) {
     switch (opcode) {
     case 0x00E0:
       // Clear the display.
-      memset(sys->Display, 0, sizeof(sys->Display));
+      memset(sys->Display, 0, DISPLAY_SIZE);
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Cleared the display.\n", opcode);
+      cost = COST(CLEAR);
       break;
     // 0x00EE: Return from subroutine.
     case 0x00EE:
+      // Returning with nothing on the stack, halt.
+      if (sys->StackPointer == 0) {
+        raiseFault(sys, CHIP8_FAULT_STACK);
+        simpleLog(WARN, "Stack Underflow.\n");
+        cost = COST(RETURN);
+        break;
+      }
       // Set the PC to the value from the top of the stack.
       sys->PC = sys->Stack[sys->StackPointer];
       // Decrement StackPointer.
@@ -111,9 +506,11 @@ void cycleSystem(Chip8 *sys) {
       sys->PC += 2;
       simpleLog(INFO, "%#04X - Returned from subroutine.(PC=%#03X and SP=%i)\n",
                 opcode, sys->PC, sys->StackPointer);
+      cost = COST(RETURN);
       break;
     default:
       simpleLog(WARN, "Unknown opcode: %x.\n", opcode);
+      cost = COST(UNKNOWN);
       break;
     }
     break;
@@ -123,19 +520,22 @@ void cycleSystem(Chip8 *sys) {
     sys->PC = (opcode & 0x0FFF);
     simpleLog(INFO, "%#04X - Jumped to NNN=%#03X PC=%#03X.\n", opcode,
               (opcode & 0x0FFF), sys->PC);
+    cost = COST(JUMP);
     break;
 
   // 0x2NNN: Call subroutine.
   case 0x2000:
+    // If the push would go outside of the stack halt instead.
+    if (sys->StackPointer >= STACK_DEPTH - 1) {
+      raiseFault(sys, CHIP8_FAULT_STACK);
+      simpleLog(WARN, "Stack Depth Exceeded.\n");
+      cost = COST(CALL);
+      break;
+    }
     // Increment the stack pointer.
     sys->StackPointer++;
     // Push the current value of the PC to the stack.
     sys->Stack[sys->StackPointer] = sys->PC;
-    // If pointing to outside of stack throw error.
-    if (sys->StackPointer >= 64) {
-      sys->Quit = 1;
-      simpleLog(WARN, "Stack Depth Exceeded.\n");
-    }
     // Set the PC to NNN.
     sys->PC = (opcode & 0x0FFF);
     // sys->PC += 2;
@@ -144,6 +544,7 @@ void cycleSystem(Chip8 *sys) {
         "%#04X - Called a subroutine added current PC to the stack. Jumped "
         "to %#03X. SP is %i.\n",
         opcode, sys->PC, sys->StackPointer);
+    cost = COST(CALL);
     break;
 
   // 0x3XNN: Skip if VX == NN.
@@ -154,10 +555,11 @@ void cycleSystem(Chip8 *sys) {
       simpleLog(INFO, "%#06X - Skipped as (V%X=%#04X) == (NN=%#04X)\n", opcode,
                 X, sys->V[X], (opcode & 0x00FF));
     } else {
-      simpleLog(INFO, "%#04X - Not Skipped as (V%X=%#04X) != (NN=%#04X)\n",
-                opcode, X, sys->PC, (opcode & 0x00FF));
+      simpleLog(INFO, "%#06X - Not skipped as (V%X=%#04X) != (NN=%#04X)\n",
+                opcode, X, sys->V[X], (opcode & 0x00FF));
     }
     sys->PC += 2;
+    cost = COST(SKIP);
     break;
 
   // 0x4XNN: Skip if VX != NN.
@@ -172,6 +574,7 @@ void cycleSystem(Chip8 *sys) {
                 opcode, X, sys->V[X], (opcode & 0x00FF));
     }
     sys->PC += 2;
+    cost = COST(SKIP);
     break;
 
   // 0x5XY0: Skip if VX == VY.
@@ -180,12 +583,14 @@ void cycleSystem(Chip8 *sys) {
     if (sys->V[X] == sys->V[Y]) {
       // Skip an instruction.
       sys->PC += 2;
-      simpleLog(INFO, "%#06X - Skipped as (V%X=%#04X) == (VY=%#04X)\n", opcode,
-                X, sys->V[X], sys->V[Y]);
+      simpleLog(INFO, "%#06X - Skipped as (V%X=%#04X) == (V%X=%#04X)\n",
+                opcode, X, sys->V[X], Y, sys->V[Y]);
+    } else {
+      simpleLog(INFO, "%#06X - Not skipped as (V%X=%#04X) != (V%X=%#04X)\n",
+                opcode, X, sys->V[X], Y, sys->V[Y]);
     }
     sys->PC += 2;
-    simpleLog(INFO, "%#06X - Not skipped as (V%X=%#04X) != (VY=%#04X)\n",
-              opcode, X, sys->V[X], (opcode & 0x00FF));
+    cost = COST(SKIP_REGISTERS);
     break;
 
   // 0x6XNN: Set register X.
@@ -193,6 +598,7 @@ void cycleSystem(Chip8 *sys) {
     sys->V[X] = (opcode & 0x00FF);
     sys->PC += 2;
     simpleLog(INFO, "%#06X - Set V%X = %#04X\n", opcode, X, sys->V[X]);
+    cost = COST(SET);
     break;
 
   // 0x7XNN: Add NN to register X.
@@ -201,8 +607,9 @@ void cycleSystem(Chip8 *sys) {
     uint8_t VX = sys->V[X];
     sys->V[X] += NN;
     sys->PC += 2;
-    simpleLog(INFO, "%#06X - Set V%X = V%X(%#04i) + NN(%#04i) = %#04i\n",
+    simpleLog(INFO, "%#06X - Set V%X = V%X(%#04X) + NN(%#04X) = %#04X\n",
               opcode, X, X, VX, NN, sys->V[X]);
+    cost = COST(ADD);
     break;
   }
 
@@ -213,45 +620,49 @@ void cycleSystem(Chip8 *sys) {
       // Set VX to VY.
       sys->V[X] = sys->V[Y];
       sys->PC += 2;
-      simpleLog(INFO, "%#06X - Set V%X=VY(%#04X)\n", opcode, X, sys->V[X]);
+      simpleLog(INFO, "%#06X - Set V%X=V%X(%#04X)\n", opcode, X, Y, sys->V[X]);
+      cost = COST(ALU);
       break;
 
     // 0x8XY1: Binary or between VX and VY -> VX.
     case 0x0001: {
-      int8_t VX = sys->V[X];
-      int8_t VY = sys->V[Y];
+      uint8_t VX = sys->V[X];
+      uint8_t VY = sys->V[Y];
       sys->V[X] = sys->V[X] | sys->V[Y];
       sys->V[0xF] = 0;
       sys->PC += 2;
       simpleLog(INFO,
                 "%#06X - Binary OR. V%X = V%X(%#04X) | V%X(%#04X) = %#04X\n",
                 opcode, X, X, VX, Y, VY, sys->V[X]);
+      cost = COST(ALU);
       break;
     }
 
     // 0x8XY2: Binary and between VX and VY -> VX.
     case 0x0002: {
-      int8_t VX = sys->V[X];
-      int8_t VY = sys->V[Y];
+      uint8_t VX = sys->V[X];
+      uint8_t VY = sys->V[Y];
       sys->V[X] = sys->V[X] & sys->V[Y];
       sys->V[0xF] = 0;
       sys->PC += 2;
       simpleLog(INFO,
                 "%#06X - Binary AND. V%X = V%X(%#04X) & V%X(%#04X) = %#04X\n",
                 opcode, X, X, VX, Y, VY, sys->V[X]);
+      cost = COST(ALU);
       break;
     }
 
     // 0x8XY3: Bitwise xor between VX and VY -> VX.
     case 0x0003: {
-      int8_t VX = sys->V[X];
-      int8_t VY = sys->V[Y];
+      uint8_t VX = sys->V[X];
+      uint8_t VY = sys->V[Y];
       sys->V[X] = sys->V[X] ^ sys->V[Y];
       sys->V[0xF] = 0;
       sys->PC += 2;
       simpleLog(INFO,
                 "%#06X - Binary XOR. V%X = V%X(%#04X) ^ V%X(%#04X) = %#04X\n",
                 opcode, X, X, VX, Y, VY, sys->V[X]);
+      cost = COST(ALU);
       break;
     }
 
@@ -267,6 +678,7 @@ void cycleSystem(Chip8 *sys) {
           INFO,
           "%#06X - Add V%X and V%X. V%X = V%X(%#04X) + V%X(%#04X) = %#04X\n",
           opcode, X, Y, X, X, VX, Y, VY, sys->V[X]);
+      cost = COST(ALU);
       break;
     }
 
@@ -284,6 +696,7 @@ void cycleSystem(Chip8 *sys) {
           "%#04X. VF = %i\n",
           opcode, Y, X, X, X, VX, Y, VY, sys->V[X], sys->V[0xF]);
 
+      cost = COST(ALU);
       break;
     }
 
@@ -303,6 +716,7 @@ void cycleSystem(Chip8 *sys) {
           "%#06X - Shift V%X one bit right. V%X = V%X(%#04X) >> 1 = %#04X. "
           "VF = %i.\n",
           opcode, X, X, X, VX, sys->V[X], sys->V[0xF]);
+      cost = COST(ALU);
       break;
     }
 
@@ -318,6 +732,7 @@ void cycleSystem(Chip8 *sys) {
           "%#06X - Subtract V%X from V%X. V%X = V%X(%#04X) - V%X(%#04X) = "
           "%#04X. VF = %i\n",
           opcode, X, Y, X, X, VX, Y, VY, sys->V[X], sys->V[0xF]);
+      cost = COST(ALU);
       break;
     }
 
@@ -337,11 +752,13 @@ void cycleSystem(Chip8 *sys) {
           "%#06X - Shift V%X one bit right. V%X = V%X(%#04X) >> 1 = %#04X. "
           "VF = %i.\n",
           opcode, X, X, X, VX, sys->V[X], sys->V[0xF]);
+      cost = COST(ALU);
       break;
     }
 
     default:
-      simpleLog(WARN, "%#06X - Unknown opcode: .\n", opcode);
+      simpleLog(WARN, "Unknown opcode: %#06X.\n", opcode);
+      cost = COST(UNKNOWN);
       break;
     }
     break;
@@ -358,6 +775,7 @@ void cycleSystem(Chip8 *sys) {
                 opcode, X, sys->V[X], Y, sys->V[Y]);
     }
     sys->PC += 2;
+    cost = COST(SKIP_REGISTERS);
     break;
 
   // 0xANNN: Set I register to NNN.
@@ -365,6 +783,7 @@ void cycleSystem(Chip8 *sys) {
     sys->I = (opcode & 0x0FFF);
     sys->PC += 2;
     simpleLog(INFO, "%#06X - Set I to %#03X\n", opcode, (opcode & 0x0FFF));
+    cost = COST(INDEX);
     break;
 
   // 0xBNNN: Set PC <- NNN + V0.
@@ -374,15 +793,17 @@ void cycleSystem(Chip8 *sys) {
     // sys->PC += 2;
     simpleLog(INFO, "%#06X - Set PC = %#05X + V0(%#04X) = %#04X\n", opcode,
               opcode & 0x0FFF, sys->V[0], sys->PC);
+    cost = COST(JUMP_OFFSET);
     break;
 
   // 0xCXNN: Generate a random 8 bit number, r. VX <- r & NN.
   case 0xC000: {
-    uint8_t r = rand() % 256; // Random num between 0 and 255
+    uint8_t r = nextRandom(sys); // Random num between 0 and 255
     sys->V[X] = r & (opcode & 0x00FF);
     sys->PC += 2;
     simpleLog(INFO, "%#06X - Set V%X = rand(%#04X) & %#04X = %#04X\n", opcode,
               X, r, opcode & 0x00FF, sys->V[X]);
+    cost = COST(RANDOM);
     break;
   }
 
@@ -396,7 +817,7 @@ void cycleSystem(Chip8 *sys) {
 
     // For y in height
     for (int lineCount = 0; lineCount < N; lineCount++) {
-      int8_t spriteBlock = sys->Memory[(sys->I) + lineCount];
+      int8_t spriteBlock = READ_MEMORY(sys, sys->I + lineCount);
 
       // From most to least significant bit.
       int x_moved = 0;
@@ -431,6 +852,7 @@ void cycleSystem(Chip8 *sys) {
     sys->PC += 2;
     simpleLog(INFO, "%#06X - Drawn to display.(VX=%#04X, VY=%#04X)\n", opcode,
               sys->V[X], sys->V[Y]);
+    cost = drawCost(sys, N);
     break;
   }
 
@@ -438,7 +860,7 @@ void cycleSystem(Chip8 *sys) {
     switch (opcode & 0xF0FF) {
     // 0xEX9E: Skip if key VX is pressed.
     case 0xE09E:
-      if (sys->Keyboard[sys->V[X]]) {
+      if (READ_KEY(sys, sys->V[X])) {
         sys->PC += 2;
         simpleLog(INFO, "%#06X - Skipped as key V%X=%#04X is pressed.\n",
                   opcode, X, sys->V[X]);
@@ -448,22 +870,26 @@ void cycleSystem(Chip8 *sys) {
                   opcode, X, sys->V[X]);
       }
       sys->PC += 2;
+      cost = COST(KEY);
       break;
 
     // 0xEXA1: Skip if key VC is not pressed.
     case 0xE0A1:
-      if (!sys->Keyboard[sys->V[X]]) {
+      if (!READ_KEY(sys, sys->V[X])) {
         sys->PC += 2;
         simpleLog(INFO, "%#06X - Skipped as key V%X=%#04X is not pressed.\n",
                   opcode, X, sys->V[X]);
+      } else {
+        simpleLog(INFO, "%#06X - Not skipped as key V%X=%#04X is pressed.\n",
+                  opcode, X, sys->V[X]);
       }
       sys->PC += 2;
-      simpleLog(INFO, "%#06X - Not skipped as key V%X=%#04X is pressed.\n",
-                opcode, X, sys->V[X]);
+      cost = COST(KEY);
       break;
 
     default:
-      printf("Unknown opcode: %X.\n", opcode);
+      simpleLog(WARN, "Unknown opcode: %#06X.\n", opcode);
+      cost = COST(UNKNOWN);
       break;
     }
     break;
@@ -472,10 +898,11 @@ void cycleSystem(Chip8 *sys) {
     switch (opcode & 0x00FF) {
     // 0xFX07:  Set VX = DelayTimer.
     case 0x0007:
-      sys->V[X] = sys->DelayTimer;
+      sys->V[X] = readTimer(sys, sys->DelayExpiry);
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Set V%X= delay timer(%#04X).\n", opcode, X,
                 sys->V[X]);
+      cost = COST(TIMER);
       break;
 
     // 0xFX0A: Wait until a key is pressed the store the value of that
@@ -495,35 +922,39 @@ void cycleSystem(Chip8 *sys) {
       // Only increment the PC if key_pressed.
       if (key_pressed) {
         sys->PC += 2;
-        simpleLog(INFO, "%#06X - %#04X key pressed.\n", opcode);
+        simpleLog(INFO, "%#06X - %#04X key pressed.\n", opcode, sys->V[X]);
       } else {
         simpleLog(INFO, "%#06X - Waiting for key to be pressed.\n", opcode);
       }
+      cost = COST(WAIT_KEY);
       break;
     }
     // 0xFX15:  Set DelayTimer = VX.
     case 0x0015:
-      sys->DelayTimer = sys->V[X];
+      sys->DelayExpiry = timerExpiry(sys, sys->V[X]);
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Set delay timer = V%X(%#04X) \n", opcode, X,
                 sys->V[X]);
+      cost = COST(TIMER);
       break;
 
     // 0xFX18: Set SoundTimer = VX.
     case 0x0018:
-      sys->SoundTimer = sys->V[X];
+      setSoundTimer(sys, sys->V[X]);
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Set sound timer = V%X(%#04X) \n", opcode, X,
                 sys->V[X]);
+      cost = COST(TIMER);
       break;
 
     // 0xFX1E: Set I=VX+I.
     case 0x001E: {
-      int8_t I = sys->I;
+      uint16_t I = sys->I;
       sys->I = sys->I + sys->V[X];
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Set I = V%X(%#04X) + I(%#04X) = %#04X\n", opcode,
                 X, sys->V[X], I, sys->I);
+      cost = COST(ADD_INDEX);
       break;
     }
 
@@ -534,6 +965,7 @@ void cycleSystem(Chip8 *sys) {
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Set I = location of char %i = %#04X\n", opcode,
                 sys->V[X], sys->I);
+      cost = COST(FONT);
       break;
 
     // 0xFX33: Store VX as 3 digits in BDC at addresses I, I+1 and I+2.
@@ -541,10 +973,9 @@ void cycleSystem(Chip8 *sys) {
       // Get the number from VX.
       uint8_t numb = sys->V[X];
       // Store in memory.
-      sys->Memory[sys->I] = (numb % 1000) / 100;
-      sys->Memory[sys->I + 1] = (numb % 100) / 10;
-      sys->Memory[sys->I + 2] = (numb % 10);
       sys->PC += 2;
+      cost = COST(DIGITS);
+      storeDigits(sys, sys->I, numb);
       simpleLog(INFO,
                 "%#06X - V%X(%X) -> [%#04x] = %i, [%#04x] = %i, [%#04x] = %i\n",
                 opcode, X, sys->V[X], sys->I, (numb % 1000) / 100, sys->I + 1,
@@ -554,13 +985,11 @@ void cycleSystem(Chip8 *sys) {
 
     // 0xFX55: Read V0->VX into memory starting at memory address I.
     case 0x0055: {
-      int index = sys->I;
-      for (int i = 0; i <= X; i++) {
-        sys->Memory[index] = sys->V[i];
-        index++;
-      }
+      uint16_t address = sys->I;
       sys->I++;
       sys->PC += 2;
+      cost = COST(STORE) + X * COST(STORE_REGISTER);
+      storeBytes(sys, address, sys->V, X + 1);
       simpleLog(INFO,
                 "%#06X - Read from V0 -> V%X into memory starting at %#06X\n",
                 opcode, X, sys->I);
@@ -571,24 +1000,47 @@ void cycleSystem(Chip8 *sys) {
     case 0x0065: {
       int index = sys->I;
       for (int i = 0; i <= X; i++) {
-        sys->V[i] = sys->Memory[index];
+        sys->V[i] = READ_MEMORY(sys, index);
         index++;
       }
       sys->I++;
       sys->PC += 2;
       simpleLog(INFO, "%#06X - Read memory into V0 -> V%X starting at %#06X\n",
                 opcode, X, sys->I);
+      cost = COST(STORE) + X * COST(STORE_REGISTER);
       break;
     }
     default:
       simpleLog(WARN, "Unknown opcode: %#06X.\n", opcode);
+      cost = COST(UNKNOWN);
       break;
     }
     break;
   default:
     simpleLog(WARN, "Unknown opcode: %#06X.\n", opcode);
+    cost = COST(UNKNOWN);
     break;
   }
+  return cost;
+}
+
+/**
+ * Make one cycle of the fetch-decode-execute cycle.
+ *
+ * Returns:
+ *  unsigned: The cycles the instruction took, see Chip8Profile.
+ */
+unsigned cycleSystem(Chip8 *sys) {
+  // Tracing costs two predictable branches when off.
+  if (sys->Trace != NULL) {
+    traceBefore(sys->Trace, sys);
+  }
+  unsigned cost = executeInstruction(sys);
+  if (sys->Trace != NULL) {
+    traceAfter(sys->Trace, sys);
+  }
+  sys->Cycles += cost;
+  return cost;
 }
 
 /**
@@ -597,8 +1049,6 @@ void cycleSystem(Chip8 *sys) {
  * Parameters:
  *  char* filePath: The path of the rom.
  *  Chip8* sys: The system whoes memory to use.
- * Returns:
- *  int: A status code, 1 for succesfully loaded -1 for not.
  */
 void loadRom(char *filePath, Chip8 *sys) {
   FILE *fp = fopen(filePath, "rb");
@@ -610,21 +1060,26 @@ void loadRom(char *filePath, Chip8 *sys) {
   }
 
   // Read the rom into memory starting at 0x200
-  fread(sys->Memory + 0x200, 1, 4096 - 0x200, fp);
+  uint8_t rom[MEMORY_SIZE - 0x200];
+  size_t size = fread(rom, 1, sizeof(rom), fp);
+  fclose(fp);
+  memoryLoad(sys, 0x200, rom, size);
 }
 
 /**
- * Decrement delay and sound timers if they are > 0. Should runat a rate of
- * ~60hz.
+ * Load a rom that is already in memory, e.g. one embedded in a harness.
  *
  * Parameters:
- *  Chip8* sys: The system state.
+ *  Chip8* sys: The system whoes memory to use.
+ *  const uint8_t* data: The rom image.
+ *  size_t size: The size of the rom in bytes.
+ * Returns:
+ *  int: 0 if loaded, -1 if the rom doesn't fit in 0x200->0xFFF.
  */
-void decrementTimers(Chip8 *sys) {
-  if (sys->DelayTimer > 0) {
-    sys->DelayTimer--;
-  }
-  if (sys->SoundTimer > 0) {
-    sys->SoundTimer--;
+int loadRomData(Chip8 *sys, const uint8_t *data, size_t size) {
+  if (size > MEMORY_SIZE - 0x200) {
+    return -1;
   }
+  memoryLoad(sys, 0x200, data, size);
+  return 0;
 }
@@ -2,8 +2,76 @@
 #define CPU_H
 
 // For
+#include <stddef.h>
 #include <stdint.h>
 
+#include "chip8.h"
+
+#define CACHE_LINE_SIZE 64
+
+#define STACK_DEPTH 64
+#define DISPLAY_SIZE (CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT)
+
+// The kinds of instruction that a profile gives a cost to.
+enum chip8Costs {
+  COST_CLEAR,          // 00E0
+  COST_RETURN,         // 00EE
+  COST_JUMP,           // 1NNN
+  COST_CALL,           // 2NNN
+  COST_SKIP,           // 3XNN, 4XNN
+  COST_SKIP_REGISTERS, // 5XY0, 9XY0
+  COST_SET,            // 6XNN
+  COST_ADD,            // 7XNN
+  COST_ALU,            // 8XYN
+  COST_INDEX,          // ANNN
+  COST_JUMP_OFFSET,    // BNNN
+  COST_RANDOM,         // CXNN
+  COST_DRAW,           // DXYN, plus COST_DRAW_ROW per row
+  COST_DRAW_ROW,
+  COST_KEY,            // EX9E, EXA1
+  COST_TIMER,          // FX07, FX15, FX18
+  COST_WAIT_KEY,       // FX0A, each time it checks the keys
+  COST_ADD_INDEX,      // FX1E
+  COST_FONT,           // FX29
+  COST_DIGITS,         // FX33
+  COST_STORE,          // FX55, FX65, plus COST_STORE_REGISTER per VX past V0
+  COST_STORE_REGISTER,
+  COST_UNKNOWN,        // Opcodes that do nothing
+  COST_COUNT
+};
+
+/**
+ * How long instructions take on the machine being emulated, in cycles of
+ * that machine. Picked with setProfile, see chip8Profiles.
+ */
+typedef struct Chip8Profile {
+  uint16_t Costs[COST_COUNT];
+
+  /**
+   * Cycles per frame: the cycles in one 60hz frame, i.e. between timer
+   * decrements.
+   */
+  uint32_t CyclesPerFrame;
+
+  /**
+   * Display wait: whether DXYN waits for the start of the next frame.
+   */
+  int DisplayWait;
+} Chip8Profile;
+
+/**
+ * The state of one machine. Stepping many machines in turn is bound by how
+ * many cache lines each instruction touches, so the struct is cache line
+ * aligned and laid out by how often a field is used:
+ *
+ *  - The first line holds everything nearly every instruction reads or
+ *    writes, including the pointer to the display.
+ *  - The stack and page table follow, each call or fetch reads one line.
+ *  - Everything else is only touched by a few instructions or by the host.
+ *    The DISPLAY_SIZE bytes of display follow the struct in the same
+ *    allocation, reached through the pointer so the struct's size stays
+ *    what the layout above makes it.
+ */
 typedef struct Chip8 {
   /**
    * General purpose registers: 16 8-bit general purpose variable registers
@@ -25,40 +93,91 @@ typedef struct Chip8 {
   uint16_t PC;
 
   /**
-   * The stack: used to to call subroutines/functions and return from them. Has
-   * a max depth of 64.
+   * The stack pointer: a pseudo register, points to the top of the stack.
    */
-  uint16_t Stack[64];
+  uint8_t StackPointer;
+
+  int Quit;
 
   /**
-   * The stack pointer: a pseudo register, points to the top of the stack.
+   * Random state: the xorshift state used by CXNN. Kept per instance so that
+   * machines are independent and reproducible from their seed.
    */
-  uint8_t StackPointer;
+  uint32_t RandomState;
 
   /**
-   * Memory: 4096 bytes of memory
+   * Cycles: the cycles run so far, the machine's clock. Each instruction
+   * adds its cost in Profile.
+   */
+  uint64_t Cycles;
+
+  /**
+   * Profile: the cost of each instruction and the length of a frame, shared
+   * by every machine with the same profile (see setProfile).
+   */
+  const Chip8Profile *Profile;
+
+  /**
+   * Trace: the binary trace being recorded, NULL when not tracing.
+   */
+  struct Chip8Trace *Trace;
+
+  /**
+   * Display: an array of DISPLAY_SIZE pixels making up the display. Each
+   * value is either 1 or 0.
+   */
+  uint8_t *Display;
+
+  /**
+   * The stack: used to to call subroutines/functions and return from them. Has
+   * a max depth of STACK_DEPTH.
+   */
+  uint16_t Stack[STACK_DEPTH];
+
+  /**
+   * Memory: 4096 bytes of memory in 16 pages of 256, which forks share until
+   * one of them writes to the page. Only access it through memory.h.
    *
    * 0x000 -> 0x1FF for the interpreter itself.
    * 0x200 -> 0xFFF to load the rom.
    */
-  uint8_t Memory[4096];
+  struct Chip8Page *Pages[16];
 
   /**
-   * Display: an array representing the pixels making up the display. Each
-   * value is either 1 or 0.
+   * Writable: the bytes of page n if they can be written directly, NULL if
+   * the page may be shared or its hash is cached, see memoryWrite.
+   */
+  uint8_t *Writable[16];
+
+  /**
+   * Profile ID: which of chip8Profiles Profile is.
    */
-  uint8_t Display[64 * 32];
+  int ProfileId;
 
   /**
-   * Delay Timer: decremented 60 times a second until it reaches 0.
+   * Delay Timer: the cycle the delay timer reaches 0 at. It counts down (60
+   * times a second) once every Profile->CyclesPerFrame cycles, so its value
+   * is worked out from Cycles when read (see readTimer) and nothing has to
+   * tick it.
    */
-  uint8_t DelayTimer;
+  uint64_t DelayExpiry;
 
   /**
-   * Sounder Timer: decremented 60 times a second until it reaches 0. Beeps
-   * when > 0.
+   * Sound Timer: the cycle the sound timer reaches 0 at, like DelayExpiry.
+   * Beeps when > 0.
    */
-  uint8_t SoundTimer;
+  uint64_t SoundExpiry;
+
+  /**
+   * Sound events: changes to the beep not yet taken by pollSound, a ring of
+   * CHIP8_SOUND_EVENTS starting at SoundEventHead. The event for the current
+   * beep ending is only queued once Cycles passes SoundExpiry, SoundEnding
+   * is set until it has been.
+   */
+  Chip8SoundEvent SoundEvents[CHIP8_SOUND_EVENTS];
+  int SoundEventHead;
+  int SoundEventCount;
+  int SoundEnding;
 
   /**
    * Keyboard: A map of the state of keys, 0 representing not pressed and 1
@@ -69,14 +188,26 @@ typedef struct Chip8 {
    */
   uint8_t Keyboard[16];
 
-  int Quit;
   int FileNotFound;
 
-} Chip8;
+  /**
+   * Fault: why the system stopped itself, one of chip8Faults.
+   */
+  int Fault;
+} __attribute__((aligned(CACHE_LINE_SIZE))) Chip8;
 
 Chip8 *systemInit();
-void cycleSystem(Chip8 *sys);
-void decrementTimers(Chip8 *sys);
+Chip8 *systemFork(Chip8 *sys);
+void systemFree(Chip8 *sys);
+void systemReset(Chip8 *sys);
+void raiseFault(Chip8 *sys, int fault);
+void seedRandom(Chip8 *sys, uint32_t seed);
+int setProfile(Chip8 *sys, int profile);
+unsigned cycleSystem(Chip8 *sys);
+uint8_t readTimer(const Chip8 *sys, uint64_t expiry);
+uint64_t timerExpiry(const Chip8 *sys, uint8_t value);
+int pollSound(Chip8 *sys, Chip8SoundEvent *event);
 void loadRom(char *filePath, Chip8 *sys);
+int loadRomData(Chip8 *sys, const uint8_t *data, size_t size);
 
 #endif
@@ -0,0 +1,433 @@
+/**
+ * Interactive debugger, see debugger.h.
+ */
+#include "debugger.h"
+#include "disasm.h"
+#include "memory.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char *helpText =
+    "c, continue         Run until a breakpoint, a watchpoint or a command.\n"
+    "s, step [n]         Run n instructions (enter on its own steps one).\n"
+    "n, next             Step, running calls (2NNN) until they return.\n"
+    "f, finish           Run until the current subroutine returns.\n"
+    "b, break ADDR       Set a breakpoint.\n"
+    "d, delete ADDR      Remove a breakpoint.\n"
+    "w, watch ADDR|VX|I  Stop when a byte of memory or a register changes.\n"
+    "unwatch [n]         Remove watchpoint n, or all of them.\n"
+    "i, info             List breakpoints and watchpoints.\n"
+    "l, list [ADDR] [n]  Disassemble n instructions from ADDR (default PC).\n"
+    "r, regs             Show the registers.\n"
+    "m, mem ADDR [n]     Show n bytes of memory.\n"
+    "q, quit             Stop the interpreter.\n";
+
+/**
+ * Work out whether the checking dispatch loop is needed.
+ */
+static void updateArmed(Chip8Debugger *dbg) {
+  dbg->Armed = dbg->BreakpointCount > 0 || dbg->WatchpointCount > 0 ||
+               dbg->Mode != DEBUG_RUN;
+}
+
+/**
+ * Create a debugger for a system, talking over in and out (e.g. stdin and
+ * stdout). It starts disarmed.
+ */
+Chip8Debugger *debuggerCreate(Chip8 *sys, FILE *in, FILE *out) {
+  Chip8Debugger *dbg = calloc(1, sizeof(Chip8Debugger));
+  if (dbg == NULL) {
+    return NULL;
+  }
+  dbg->Sys = sys;
+  dbg->In = in;
+  dbg->Out = out;
+  dbg->Mode = DEBUG_RUN;
+  // Unbuffered, so a line typed ahead is never held by stdio where
+  // debuggerPoll can't see it.
+  setvbuf(dbg->In, NULL, _IONBF, 0);
+  return dbg;
+}
+
+/**
+ * Wait for a client on a unix socket and talk to it instead of In/Out.
+ *
+ * Returns:
+ *  int: 0 once a client has connected, -1 on error.
+ */
+int debuggerListen(Chip8Debugger *dbg, const char *socketPath) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, socketPath);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return -1;
+  }
+  unlink(socketPath);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 1) != 0) {
+    close(listener);
+    return -1;
+  }
+
+  fprintf(dbg->Out, "Waiting for debugger on %s\n", socketPath);
+  int client = accept(listener, NULL, NULL);
+  close(listener);
+  unlink(socketPath);
+  if (client < 0) {
+    return -1;
+  }
+
+  dbg->In = fdopen(client, "r");
+  dbg->Out = fdopen(dup(client), "w");
+  setvbuf(dbg->In, NULL, _IONBF, 0);
+  setvbuf(dbg->Out, NULL, _IOLBF, 0);
+  return 0;
+}
+
+/**
+ * Free a debugger, closing its socket if it has one.
+ */
+void debuggerDestroy(Chip8Debugger *dbg) {
+  if (dbg->In != stdin) {
+    fclose(dbg->In);
+  }
+  if (dbg->Out != stdout) {
+    fclose(dbg->Out);
+  }
+  free(dbg);
+}
+
+/**
+ * Stop before the next instruction.
+ */
+void debuggerBreak(Chip8Debugger *dbg) {
+  dbg->Mode = DEBUG_STEP;
+  dbg->Steps = 0;
+  updateArmed(dbg);
+}
+
+/**
+ * Stop before the next instruction if a command has been typed, without
+ * waiting for one. Call once a frame while the machine runs, the command is
+ * then the first one read at the prompt.
+ *
+ * Returns:
+ *  int: 1 if the debugger will stop, otherwise 0.
+ */
+int debuggerPoll(Chip8Debugger *dbg) {
+  if (dbg->InputClosed) {
+    return 0;
+  }
+
+  struct pollfd input = {fileno(dbg->In), POLLIN, 0};
+  if (poll(&input, 1, 0) <= 0) {
+    return 0;
+  }
+  debuggerBreak(dbg);
+  return 1;
+}
+
+/**
+ * The current value of whatever a watchpoint watches.
+ */
+static uint16_t watchValue(Chip8 *sys, Watchpoint *watch) {
+  switch (watch->Type) {
+  case WATCH_REGISTER:
+    return sys->V[watch->Index];
+  case WATCH_INDEX:
+    return sys->I;
+  default:
+    return memoryRead(sys, watch->Index);
+  }
+}
+
+// The hex digits of a watched value, I is 12 bits and the rest bytes.
+#define WATCH_DIGITS(watch) ((watch)->Type == WATCH_INDEX ? 3 : 2)
+
+static void printWatch(Chip8Debugger *dbg, Watchpoint *watch) {
+  switch (watch->Type) {
+  case WATCH_REGISTER:
+    fprintf(dbg->Out, "V%X", watch->Index);
+    break;
+  case WATCH_INDEX:
+    fprintf(dbg->Out, "I");
+    break;
+  default:
+    fprintf(dbg->Out, "[%03X]", watch->Index);
+    break;
+  }
+}
+
+/**
+ * Whether to stop before the instruction at PC.
+ */
+static int shouldStop(Chip8Debugger *dbg) {
+  Chip8 *sys = dbg->Sys;
+  int stop = 0;
+
+  // Watchpoints report what the previous instruction changed.
+  for (int i = 0; i < dbg->WatchpointCount; i++) {
+    Watchpoint *watch = &dbg->Watchpoints[i];
+    uint16_t value = watchValue(sys, watch);
+    if (value != watch->Value) {
+      fprintf(dbg->Out, "Watchpoint %i: ", i);
+      printWatch(dbg, watch);
+      fprintf(dbg->Out, " 0x%0*X -> 0x%0*X\n", WATCH_DIGITS(watch),
+              watch->Value, WATCH_DIGITS(watch), value);
+      watch->Value = value;
+      stop = 1;
+    }
+  }
+
+  if (!dbg->Resuming && dbg->Breakpoints[sys->PC & 0xFFF]) {
+    fprintf(dbg->Out, "Breakpoint at %03X\n", sys->PC);
+    stop = 1;
+  }
+
+  switch (dbg->Mode) {
+  case DEBUG_STEP:
+    stop |= dbg->Steps <= 0;
+    break;
+  case DEBUG_NEXT:
+    stop |= sys->PC == dbg->TargetPC && sys->StackPointer == dbg->TargetDepth;
+    break;
+  case DEBUG_FINISH:
+    stop |= sys->StackPointer < dbg->TargetDepth;
+    break;
+  }
+  return stop;
+}
+
+/**
+ * Run up to cycles instructions, checking breakpoints, watchpoints and steps
+ * before each one. Stopped is set if one of them was hit.
+ *
+ * Returns:
+ *  int: The number of instructions run.
+ */
+int debuggerRun(Chip8Debugger *dbg, int cycles) {
+  Chip8 *sys = dbg->Sys;
+  int count = 0;
+
+  dbg->Stopped = 0;
+  while (count < cycles && !sys->Quit) {
+    if (shouldStop(dbg)) {
+      dbg->Stopped = 1;
+      dbg->Mode = DEBUG_RUN;
+      updateArmed(dbg);
+      break;
+    }
+    dbg->Resuming = 0;
+    cycleSystem(sys);
+    if (dbg->Mode == DEBUG_STEP) {
+      dbg->Steps--;
+    }
+    count++;
+  }
+  return count;
+}
+
+/**
+ * Print count instructions starting at address, marking PC and breakpoints.
+ */
+void debuggerList(Chip8Debugger *dbg, uint16_t address, int count) {
+  Chip8 *sys = dbg->Sys;
+  char text[32];
+
+  for (int i = 0; i < count; i++) {
+    uint16_t at = (address + i * 2) & 0xFFF;
+    uint16_t opcode = memoryFetch(sys, at);
+    disassemble(opcode, text, sizeof(text));
+    fprintf(dbg->Out, "%s%c %03X  %04X  %s\n", at == sys->PC ? "=>" : "  ",
+            dbg->Breakpoints[at] ? '*' : ' ', at, opcode, text);
+  }
+}
+
+static void printRegisters(Chip8Debugger *dbg) {
+  Chip8 *sys = dbg->Sys;
+
+  fprintf(dbg->Out, "PC=%03X I=%03X SP=%i DT=%i ST=%i\n", sys->PC, sys->I,
+          sys->StackPointer, readTimer(sys, sys->DelayExpiry),
+          readTimer(sys, sys->SoundExpiry));
+  for (int x = 0; x < 16; x++) {
+    fprintf(dbg->Out, "V%X=%02X%c", x, sys->V[x], x % 8 == 7 ? '\n' : ' ');
+  }
+}
+
+static void printMemory(Chip8Debugger *dbg, uint16_t address, int count) {
+  for (int i = 0; i < count; i++) {
+    uint16_t at = (address + i) & 0xFFF;
+    if (i % 16 == 0) {
+      fprintf(dbg->Out, "%s%03X:", i ? "\n" : "", at);
+    }
+    fprintf(dbg->Out, " %02X", memoryRead(dbg->Sys, at));
+  }
+  fprintf(dbg->Out, "\n");
+}
+
+/**
+ * Parse a watchpoint target: VX, I or a memory address.
+ */
+static void parseWatch(const char *target, Watchpoint *watch) {
+  if ((target[0] == 'V' || target[0] == 'v') && target[1] != '\0' &&
+      target[2] == '\0') {
+    watch->Type = WATCH_REGISTER;
+    watch->Index = strtol(target + 1, NULL, 16) & 0xF;
+  } else if ((target[0] == 'I' || target[0] == 'i') && target[1] == '\0') {
+    watch->Type = WATCH_INDEX;
+    watch->Index = 0;
+  } else {
+    watch->Type = WATCH_MEMORY;
+    watch->Index = strtol(target, NULL, 16) & 0xFFF;
+  }
+}
+
+/**
+ * Run one debugger command.
+ *
+ * Parameters:
+ *  Chip8Debugger* dbg: The debugger.
+ *  const char* line: The command line, see helpText.
+ * Returns:
+ *  int: 1 if the command resumes execution, 0 if not.
+ */
+int debuggerCommand(Chip8Debugger *dbg, const char *line) {
+  Chip8 *sys = dbg->Sys;
+  char command[16] = "";
+  char first[16] = "";
+  char second[16] = "";
+  int resume = 0;
+
+  sscanf(line, "%15s %15s %15s", command, first, second);
+
+  if (command[0] == '\0' || !strcmp(command, "s") ||
+      !strcmp(command, "step")) {
+    dbg->Mode = DEBUG_STEP;
+    dbg->Steps = first[0] ? atoi(first) : 1;
+    resume = 1;
+  } else if (!strcmp(command, "c") || !strcmp(command, "continue")) {
+    dbg->Mode = DEBUG_RUN;
+    resume = 1;
+  } else if (!strcmp(command, "n") || !strcmp(command, "next")) {
+    // Over a call run until it returns to the next instruction.
+    if ((memoryRead(sys, sys->PC & 0xFFF) & 0xF0) == 0x20) {
+      dbg->Mode = DEBUG_NEXT;
+      dbg->TargetPC = sys->PC + 2;
+      dbg->TargetDepth = sys->StackPointer;
+    } else {
+      dbg->Mode = DEBUG_STEP;
+      dbg->Steps = 1;
+    }
+    resume = 1;
+  } else if (!strcmp(command, "f") || !strcmp(command, "finish")) {
+    if (sys->StackPointer == 0) {
+      fprintf(dbg->Out, "Not in a subroutine.\n");
+    } else {
+      dbg->Mode = DEBUG_FINISH;
+      dbg->TargetDepth = sys->StackPointer;
+      resume = 1;
+    }
+  } else if (!strcmp(command, "b") || !strcmp(command, "break")) {
+    uint16_t address = strtol(first, NULL, 16) & 0xFFF;
+    if (!dbg->Breakpoints[address]) {
+      dbg->Breakpoints[address] = 1;
+      dbg->BreakpointCount++;
+    }
+    fprintf(dbg->Out, "Breakpoint set at %03X\n", address);
+  } else if (!strcmp(command, "d") || !strcmp(command, "delete")) {
+    uint16_t address = strtol(first, NULL, 16) & 0xFFF;
+    if (dbg->Breakpoints[address]) {
+      dbg->Breakpoints[address] = 0;
+      dbg->BreakpointCount--;
+    }
+  } else if (!strcmp(command, "w") || !strcmp(command, "watch")) {
+    if (dbg->WatchpointCount == DEBUGGER_MAX_WATCHPOINTS) {
+      fprintf(dbg->Out, "Too many watchpoints.\n");
+    } else {
+      Watchpoint *watch = &dbg->Watchpoints[dbg->WatchpointCount];
+      parseWatch(first, watch);
+      watch->Value = watchValue(sys, watch);
+      fprintf(dbg->Out, "Watchpoint %i: ", dbg->WatchpointCount++);
+      printWatch(dbg, watch);
+      fprintf(dbg->Out, "\n");
+    }
+  } else if (!strcmp(command, "unwatch")) {
+    if (first[0] == '\0') {
+      dbg->WatchpointCount = 0;
+    } else {
+      int i = atoi(first);
+      if (i >= 0 && i < dbg->WatchpointCount) {
+        memmove(&dbg->Watchpoints[i], &dbg->Watchpoints[i + 1],
+                (dbg->WatchpointCount - i - 1) * sizeof(Watchpoint));
+        dbg->WatchpointCount--;
+      }
+    }
+  } else if (!strcmp(command, "i") || !strcmp(command, "info")) {
+    for (int address = 0; address < 4096; address++) {
+      if (dbg->Breakpoints[address]) {
+        fprintf(dbg->Out, "Breakpoint at %03X\n", address);
+      }
+    }
+    for (int i = 0; i < dbg->WatchpointCount; i++) {
+      fprintf(dbg->Out, "Watchpoint %i: ", i);
+      printWatch(dbg, &dbg->Watchpoints[i]);
+      fprintf(dbg->Out, " = 0x%0*X\n", WATCH_DIGITS(&dbg->Watchpoints[i]),
+              dbg->Watchpoints[i].Value);
+    }
+  } else if (!strcmp(command, "l") || !strcmp(command, "list")) {
+    uint16_t address = first[0] ? strtol(first, NULL, 16) : sys->PC;
+    debuggerList(dbg, address, second[0] ? atoi(second) : 10);
+  } else if (!strcmp(command, "r") || !strcmp(command, "regs")) {
+    printRegisters(dbg);
+  } else if (!strcmp(command, "m") || !strcmp(command, "mem")) {
+    printMemory(dbg, strtol(first, NULL, 16), second[0] ? atoi(second) : 16);
+  } else if (!strcmp(command, "q") || !strcmp(command, "quit")) {
+    sys->Quit = 1;
+    resume = 1;
+  } else if (!strcmp(command, "h") || !strcmp(command, "help")) {
+    fprintf(dbg->Out, "%s", helpText);
+  } else {
+    fprintf(dbg->Out, "Unknown command %s, try help.\n", command);
+  }
+
+  dbg->Resuming = resume;
+  updateArmed(dbg);
+  return resume;
+}
+
+/**
+ * Show where execution stopped and read commands until one resumes it. If
+ * the input is closed execution continues without the debugger stopping.
+ */
+void debuggerPrompt(Chip8Debugger *dbg) {
+  char line[128];
+
+  debuggerList(dbg, dbg->Sys->PC, 1);
+  while (1) {
+    fprintf(dbg->Out, "(chip8) ");
+    fflush(dbg->Out);
+    if (fgets(line, sizeof(line), dbg->In) == NULL) {
+      dbg->InputClosed = 1;
+      dbg->Mode = DEBUG_RUN;
+      dbg->BreakpointCount = 0;
+      dbg->WatchpointCount = 0;
+      memset(dbg->Breakpoints, 0, sizeof(dbg->Breakpoints));
+      updateArmed(dbg);
+      return;
+    }
+    if (debuggerCommand(dbg, line)) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/**
+ * Interactive debugger: breakpoints, watchpoints, stepping and disassembly.
+ *
+ * The debugger only costs anything while it is armed (there is a breakpoint,
+ * a watchpoint or a step in progress). The caller picks its dispatch loop on
+ * Armed, running cycleSystem directly otherwise, e.g.
+ *
+ *  if (dbg->Armed) {
+ *    debuggerRun(dbg, 1);
+ *    if (dbg->Stopped)
+ *      debuggerPrompt(dbg);
+ *  } else {
+ *    cycleSystem(sys);
+ *  }
+ *
+ * and calls debuggerPoll once a frame, so a command typed while the machine
+ * runs stops it again.
+ */
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define DEBUGGER_MAX_WATCHPOINTS 16
+
+// What the debugger is waiting for.
+enum debuggerModes { DEBUG_RUN, DEBUG_STEP, DEBUG_NEXT, DEBUG_FINISH };
+
+// What a watchpoint watches.
+enum watchpointTypes { WATCH_MEMORY, WATCH_REGISTER, WATCH_INDEX };
+
+typedef struct Watchpoint {
+  int Type;
+  uint16_t Index; // The address or register number.
+  uint16_t Value; // The value when last checked.
+} Watchpoint;
+
+typedef struct Chip8Debugger {
+  Chip8 *Sys;
+
+  /**
+   * Breakpoints: one flag per address, so checking is a single load.
+   */
+  uint8_t Breakpoints[4096];
+  int BreakpointCount;
+
+  Watchpoint Watchpoints[DEBUGGER_MAX_WATCHPOINTS];
+  int WatchpointCount;
+
+  /**
+   * Mode: one of debuggerModes, with what it is waiting for.
+   *  DEBUG_STEP: Steps instructions left to run.
+   *  DEBUG_NEXT: TargetPC at stack depth TargetDepth.
+   *  DEBUG_FINISH: The stack to drop below TargetDepth.
+   */
+  int Mode;
+  int Steps;
+  uint16_t TargetPC;
+  int TargetDepth;
+
+  /**
+   * Armed: whether the checking dispatch loop is needed.
+   */
+  int Armed;
+
+  /**
+   * Stopped: set when the last debuggerRun stopped before an instruction.
+   */
+  int Stopped;
+
+  // Skip breakpoint checks for the instruction being resumed from.
+  int Resuming;
+
+  // Where commands are read from and output written.
+  FILE *In;
+  FILE *Out;
+
+  // Set once In has been closed, there is nothing left to stop for.
+  int InputClosed;
+} Chip8Debugger;
+
+Chip8Debugger *debuggerCreate(Chip8 *sys, FILE *in, FILE *out);
+int debuggerListen(Chip8Debugger *dbg, const char *socketPath);
+void debuggerDestroy(Chip8Debugger *dbg);
+void debuggerBreak(Chip8Debugger *dbg);
+int debuggerPoll(Chip8Debugger *dbg);
+int debuggerRun(Chip8Debugger *dbg, int cycles);
+int debuggerCommand(Chip8Debugger *dbg, const char *line);
+void debuggerPrompt(Chip8Debugger *dbg);
+void debuggerList(Chip8Debugger *dbg, uint16_t address, int count);
+
+#endif
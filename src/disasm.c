@@ -0,0 +1,38 @@
+/**
+ * Turn opcodes back into (Cowgod style) assembly, decoded the same way as in
+ * cycleSystem (see opcodes.h).
+ */
+#include "disasm.h"
+#include "opcodes.h"
+
+#include <stdio.h>
+
+/**
+ * Disassemble a single opcode.
+ *
+ * Parameters:
+ *  uint16_t opcode: The opcode.
+ *  char* text: Where to write the assembly.
+ *  size_t size: The size of text.
+ * Returns:
+ *  int: 1 if the opcode is an instruction cycleSystem knows, 0 if not (text
+ *       is then a DW of the raw opcode).
+ */
+int disassemble(uint16_t opcode, char *text, size_t size) {
+  unsigned x = (opcode & 0x0F00) >> 8;
+  unsigned y = (opcode & 0x00F0) >> 4;
+  unsigned n = opcode & 0x000F;
+  unsigned nn = opcode & 0x00FF;
+  unsigned nnn = opcode & 0x0FFF;
+
+#define DISASSEMBLE(mask, match, ...)                                          \
+  if ((opcode & (mask)) == (match)) {                                          \
+    snprintf(text, size, __VA_ARGS__);                                         \
+    return 1;                                                                  \
+  }
+  CHIP8_OPCODES(DISASSEMBLE)
+#undef DISASSEMBLE
+
+  snprintf(text, size, "DW   0x%04X", opcode);
+  return 0;
+}
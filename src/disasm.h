@@ -0,0 +1,9 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int disassemble(uint16_t opcode, char *text, size_t size);
+
+#endif
@@ -23,7 +23,7 @@ char *getLogLevelName(int logLevel) {
  *  char* fmt: The printf style format string.
  *  ... : The arguments the populate the format string.
  */
-void simpleLog(int logLevel, char *fmt, ...) {
+void logMessage(int logLevel, char *fmt, ...) {
   if (logLevel > LOG_LEVEL) {
     return;
   }
@@ -35,7 +35,7 @@ void simpleLog(int logLevel, char *fmt, ...) {
   va_end(argp);
 }
 
-void logRegisters(Chip8 sys) {
+void logRegisters(const Chip8 *sys) {
   for (int i = 0; i <= 0xF; i++) {
   }
 }
@@ -1,9 +1,22 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+// Can be overridden at build time, e.g. -DLOG_LEVEL=NONE for the library.
+#ifndef LOG_LEVEL
 #define LOG_LEVEL INFO
+#endif
 
 enum loggingLevels { NONE, WARN, INFO };
 
-void simpleLog(int logLevel, char *fmt, ...);
+void logMessage(int logLevel, char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Checked here rather than in logMessage so that disabled levels compile away
+// and the interpreter doesn't pay for a call per instruction.
+#define simpleLog(logLevel, ...)                                               \
+  do {                                                                         \
+    if ((logLevel) <= LOG_LEVEL) {                                             \
+      logMessage(logLevel, __VA_ARGS__);                                       \
+    }                                                                          \
+  } while (0)
 #endif
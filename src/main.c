@@ -7,33 +7,99 @@
  *  draw()
  */
 #include "cpu.h"
+#include "debugger.h"
+#include "metrics.h"
 #include "peripheral.h"
+#include "record.h"
+#include "runahead.h"
+#include "scheduler.h"
+#include "stream.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-// The ratio of cycle hrz to the hrz timers should be run at (60hz).
-#define TIMERS_RATIO 10
-// If debug is set run one instruction at a time.
-#define DEBUG 0
+static void usage(void) {
+  printf("Usage: ./a.out [options] path/to/game.ch8\n");
+  printf("  --trace path/to/trace.bin  Record a binary trace.\n");
+  printf("  --debug                    Start in the debugger.\n");
+  printf("  --debug-socket path        Start in the debugger on a socket.\n");
+  printf("  --run-ahead frames         Draw the frame this far ahead.\n");
+  printf("  --profile uniform|vip      Instruction timings to run at.\n");
+  printf("  --unthrottled              Run as fast as possible.\n");
+  printf("  --stats path               Keep live metrics in a file.\n");
+  printf("  --stats-socket path        Serve live metrics on a socket.\n");
+  printf("  --stream path              Stream the display on a socket.\n");
+  printf("  --record path              Record the session to verify.\n");
+  exit(1);
+}
 
 int main(int argc, char **argv) {
+  char *romPath = NULL;
+  char *tracePath = NULL;
+  char *debugSocket = NULL;
+  int debug = 0;
+  int runAhead = 0;
+  int profile = CHIP8_PROFILE_UNIFORM;
+  int throttle = 1;
+  char *statsPath = NULL;
+  char *statsSocket = NULL;
+  char *streamSocket = NULL;
+  char *recordPath = NULL;
 
-  // If wrong number of args passed exit.
-  if (argc != 2) {
-    printf("You passed the incorrect number of args.\n");
-    printf("Usage: ./a.out path/to/game.ch8\n");
-    exit(1);
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+      tracePath = argv[++i];
+    } else if (!strcmp(argv[i], "--debug")) {
+      debug = 1;
+    } else if (!strcmp(argv[i], "--debug-socket") && i + 1 < argc) {
+      debug = 1;
+      debugSocket = argv[++i];
+    } else if (!strcmp(argv[i], "--run-ahead") && i + 1 < argc) {
+      runAhead = atoi(argv[++i]);
+      if (runAhead < 1) {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+      i++;
+      if (!strcmp(argv[i], "uniform")) {
+        profile = CHIP8_PROFILE_UNIFORM;
+      } else if (!strcmp(argv[i], "vip")) {
+        profile = CHIP8_PROFILE_VIP;
+      } else {
+        usage();
+      }
+    } else if (!strcmp(argv[i], "--unthrottled")) {
+      throttle = 0;
+    } else if (!strcmp(argv[i], "--stats") && i + 1 < argc) {
+      statsPath = argv[++i];
+    } else if (!strcmp(argv[i], "--stats-socket") && i + 1 < argc) {
+      statsSocket = argv[++i];
+    } else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+      streamSocket = argv[++i];
+    } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (argv[i][0] != '-' && romPath == NULL) {
+      romPath = argv[i];
+    } else {
+      usage();
+    }
   }
-  // Seed random.
-  srand(time(NULL));
 
+  // If no rom passed exit.
+  if (romPath == NULL) {
+    printf("You passed the incorrect number of args.\n");
+    usage();
+  }
   // Initialise system.
   Chip8 *sys = systemInit();
+  setProfile(sys, profile);
+  // Seed random.
+  seedRandom(sys, time(NULL));
   // Load rom.
-  loadRom(argv[1], sys);
+  loadRom(romPath, sys);
 
   // If rom not loaded.
   if (sys->FileNotFound) {
@@ -41,39 +107,183 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  // If asked for record a binary trace (decode with chip8trace).
+  if (tracePath != NULL) {
+    sys->Trace = traceOpen(tracePath);
+    if (sys->Trace == NULL) {
+      printf("Couldn't open trace file.");
+      exit(1);
+    }
+  }
+
+  // If asked for record the keys with checkpoints (verify with chip8replay).
+  Chip8Recorder *rec = NULL;
+  if (recordPath != NULL) {
+    rec = recordOpen(sys, recordPath, RECORD_INTERVAL);
+    if (rec == NULL) {
+      printf("Couldn't open recording file.");
+      exit(1);
+    }
+  }
+
+  // If asked for start stopped in the debugger.
+  Chip8Debugger *dbg = NULL;
+  if (debug) {
+    dbg = debuggerCreate(sys, stdin, stdout);
+    if (debugSocket != NULL && debuggerListen(dbg, debugSocket) != 0) {
+      printf("Couldn't open debugger socket.");
+      exit(1);
+    }
+    debuggerBreak(dbg);
+  }
+
+  // If asked for draw the future frame to cut input lag.
+  Chip8RunAhead *ra = NULL;
+  if (runAhead) {
+    ra = runAheadCreate(sys, runAhead);
+    if (ra == NULL) {
+      printf("Couldn't start run-ahead.");
+      exit(1);
+    }
+  }
+
+  // If asked for export live metrics (see metrics.h), recorded once a frame.
+  Chip8Metrics *metrics = NULL;
+  Chip8MetricsShard *shard = NULL;
+  if (statsPath != NULL || statsSocket != NULL) {
+    metrics = metricsCreate();
+    if (metrics == NULL ||
+        metricsExport(metrics, statsPath, statsSocket) != 0) {
+      printf("Couldn't start metrics.");
+      exit(1);
+    }
+    shard = metricsShard(metrics);
+  }
+
+  // If asked for mirror the display to spectators (see chip8view).
+  Chip8Stream *stream = NULL;
+  if (streamSocket != NULL) {
+    stream = streamCreate();
+    if (stream == NULL || streamListen(stream, streamSocket) != 0) {
+      printf("Couldn't open stream socket.");
+      exit(1);
+    }
+  }
+
   // Initialise a display.
   displayInit();
 
-  // Used to determine the number of loops per decrement of timers.
-  int timers_count = 0;
+  // Hold the machine to the speed of the one its profile times.
+  Chip8Scheduler *sched = schedulerCreate(sys, throttle);
+  if (sched == NULL) {
+    printf("Couldn't start the scheduler.");
+    exit(1);
+  }
+
+  // The 60hz frame the last cycle was in, timers count down between frames.
+  uint32_t period = sys->Profile->CyclesPerFrame;
+  uint64_t frame = 0;
+  // What happened since the last frame, for the metrics.
+  uint64_t instructions = 0;
+  uint64_t frameCycles = 0;
+  uint64_t keyChanged = 0;
   while (1) {
 
-    cycleSystem(sys);
-    draw(sys);
-    handleEvents(sys);
+    // Only pay for the debugger's checks while it has something to check.
+    // Stopped at the prompt, the debugger runs nothing that turn.
+    if (dbg != NULL && dbg->Armed) {
+      instructions += debuggerRun(dbg, 1);
+      if (dbg->Stopped) {
+        debuggerPrompt(dbg);
+      }
+    } else {
+      cycleSystem(sys);
+      instructions++;
+    }
+    if (handleEvents(sys)) {
+      if (rec != NULL) {
+        recordInput(rec, sys);
+      }
+      if (shard != NULL && keyChanged == 0) {
+        keyChanged = metricsNow();
+      }
+    }
 
     if (sys->Quit) {
       printf("Quitting\n");
       break;
     }
 
-    // Timers should be decremented every 60hz. This is achieved by storing an
-    // approximate ratio of the system clock speed and 60hz.
-    if (timers_count == TIMERS_RATIO) {
-      timers_count = 0;     // Reset the timers count.
-      decrementTimers(sys); // Decrement the timers.
-    }
-
-    timers_count++;
+    // The timers keep themselves up to date from the cycle count, so at the
+    // end of a frame there is only drawing it and waiting for the next.
+    if (sys->Cycles / period != frame) {
+      frame = sys->Cycles / period;
+      // A command typed while running breaks back into the debugger.
+      if (dbg != NULL) {
+        debuggerPoll(dbg);
+      }
+      if (rec != NULL) {
+        recordFrame(rec, sys);
+      }
+      Chip8 *shown = ra != NULL ? runAheadFrame(ra) : sys;
+      uint64_t start = metricsNow();
+      draw(shown);
+      uint64_t drawn = metricsNow();
+      present();
+      uint64_t presented = metricsNow();
+      // The beep changes with the frame it changed in.
+      Chip8SoundEvent sound;
+      while (pollSound(sys, &sound)) {
+        beep(sound.On);
+      }
+      if (stream != NULL) {
+        streamFrame(stream, shown->Display);
+      }
+      uint64_t dropped = sched->Dropped;
+      schedulerFrame(sched);
 
-    // If debug is set wait for char to run next instrucion.
-    if (DEBUG) {
-      printf(": ");
-      getchar();
+      if (shard != NULL) {
+        metricsAdd(shard, METRIC_INSTRUCTIONS, instructions);
+        metricsAdd(shard, METRIC_CYCLES, sys->Cycles - frameCycles);
+        metricsAdd(shard, METRIC_FRAMES, 1);
+        metricsAdd(shard, METRIC_DROPPED_FRAMES, sched->Dropped - dropped);
+        metricsObserve(shard, METRIC_FRAME_CYCLES, sys->Cycles - frameCycles);
+        metricsObserve(shard, METRIC_RENDER, drawn - start);
+        metricsObserve(shard, METRIC_PRESENT, presented - drawn);
+        metricsObserve(shard, METRIC_WAIT, sched->Waited * 1e9);
+        if (keyChanged != 0) {
+          metricsObserve(shard, METRIC_INPUT_LATENCY, presented - keyChanged);
+          keyChanged = 0;
+        }
+      }
+      instructions = 0;
+      frameCycles = sys->Cycles;
     }
   }
 
   // Free up memory.
-  free(sys);
+  schedulerReport(sched, stdout);
+  schedulerDestroy(sched);
+  if (metrics != NULL) {
+    metricsDestroy(metrics);
+  }
+  if (stream != NULL) {
+    streamReport(stream, stdout);
+    streamDestroy(stream);
+  }
+  if (dbg != NULL) {
+    debuggerDestroy(dbg);
+  }
+  if (ra != NULL) {
+    runAheadReport(ra, stdout);
+    runAheadDestroy(ra);
+  }
+  if (sys->Trace != NULL && traceClose(sys->Trace) != 0) {
+    printf("Couldn't write all of the trace, it stops early.\n");
+  }
+  if (rec != NULL) {
+    recordClose(rec, sys);
+  }
+  systemFree(sys);
   displayQuit();
 }
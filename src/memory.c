@@ -0,0 +1,234 @@
+/**
+ * Paged, copy-on-write memory, see memory.h.
+ */
+#include "memory.h"
+
+#include <stdlib.h> // for malloc
+#include <string.h> // for memcpy
+
+/**
+ * Allocate a page with a single reference.
+ *
+ * Returns:
+ *  Chip8Page* The page (contents uninitialised) or NULL.
+ */
+static Chip8Page *newPage(void) {
+  Chip8Page *page = malloc(sizeof(Chip8Page));
+  if (page == NULL) {
+    return NULL;
+  }
+  page->References = 1;
+  page->Hash = 0;
+  return page;
+}
+
+/**
+ * Drop a reference to a page, freeing it with the last one.
+ */
+static void releasePage(Chip8Page *page) {
+  if (__atomic_sub_fetch(&page->References, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(page);
+  }
+}
+
+/**
+ * Give a system its own, zeroed, pages.
+ *
+ * Parameters:
+ *  Chip8* sys: The system, whose Pages aren't set up yet.
+ * Returns:
+ *  int: 0 on success, -1 if the pages couldn't be allocated.
+ */
+int memoryInit(Chip8 *sys) {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    sys->Pages[page] = newPage();
+    if (sys->Pages[page] == NULL) {
+      while (page-- > 0) {
+        releasePage(sys->Pages[page]);
+      }
+      return -1;
+    }
+    memset(sys->Pages[page]->Bytes, 0, MEMORY_PAGE_SIZE);
+    sys->Writable[page] = sys->Pages[page]->Bytes;
+  }
+  return 0;
+}
+
+/**
+ * Drop the systems references to its pages.
+ */
+void memoryFree(Chip8 *sys) {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    releasePage(sys->Pages[page]);
+  }
+}
+
+/**
+ * Share a systems pages with a fork of it. Both then copy a page before
+ * writing to it.
+ *
+ * Parameters:
+ *  Chip8* fork: The fork, whose Pages don't hold references yet.
+ *  Chip8* sys: The system it was forked from.
+ */
+void memoryFork(Chip8 *fork, Chip8 *sys) {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    __atomic_add_fetch(&sys->Pages[page]->References, 1, __ATOMIC_RELAXED);
+    fork->Pages[page] = sys->Pages[page];
+    fork->Writable[page] = NULL;
+    sys->Writable[page] = NULL;
+  }
+}
+
+/**
+ * Make a write protected page writable: copy it if another machine still
+ * uses it and drop its cached hash.
+ *
+ * Parameters:
+ *  Chip8* sys: The system about to write.
+ *  unsigned page: The page about to be written.
+ * Returns:
+ *  uint8_t*: The bytes of the page, NULL if the copy couldn't be allocated
+ *            (the system is faulted).
+ */
+uint8_t *memoryWritable(Chip8 *sys, unsigned page) {
+  Chip8Page *shared = sys->Pages[page];
+
+  if (__atomic_load_n(&shared->References, __ATOMIC_ACQUIRE) > 1) {
+    Chip8Page *copy = newPage();
+    if (copy == NULL) {
+      raiseFault(sys, CHIP8_FAULT_MEMORY);
+      return NULL;
+    }
+    memcpy(copy->Bytes, shared->Bytes, MEMORY_PAGE_SIZE);
+    sys->Pages[page] = copy;
+    releasePage(shared);
+  }
+  sys->Pages[page]->Hash = 0;
+  sys->Writable[page] = sys->Pages[page]->Bytes;
+  return sys->Writable[page];
+}
+
+/**
+ * Copy bytes into memory. Pages whose contents wouldn't change are left
+ * alone, so they stay shared (e.g. restoring a snapshot into a fork).
+ *
+ * Parameters:
+ *  Chip8* sys: The system to write to.
+ *  uint16_t address: Where to start, address + size must be <= MEMORY_SIZE.
+ *  const uint8_t* data: The bytes to copy.
+ *  size_t size: The number of bytes.
+ */
+void memoryLoad(Chip8 *sys, uint16_t address, const uint8_t *data,
+                size_t size) {
+  while (size > 0) {
+    unsigned page = address / MEMORY_PAGE_SIZE;
+    unsigned offset = address % MEMORY_PAGE_SIZE;
+    size_t length = MEMORY_PAGE_SIZE - offset;
+    if (length > size) {
+      length = size;
+    }
+
+    if (memcmp(sys->Pages[page]->Bytes + offset, data, length) != 0) {
+      uint8_t *bytes = sys->Writable[page];
+      if (bytes == NULL && (bytes = memoryWritable(sys, page)) == NULL) {
+        return;
+      }
+      memcpy(bytes + offset, data, length);
+    }
+
+    address += length;
+    data += length;
+    size -= length;
+  }
+}
+
+/**
+ * Set all of memory to 0.
+ */
+void memoryClear(Chip8 *sys) {
+  static const uint8_t zero[MEMORY_PAGE_SIZE];
+
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    memoryLoad(sys, page * MEMORY_PAGE_SIZE, zero, MEMORY_PAGE_SIZE);
+  }
+}
+
+/**
+ * Copy all of memory out into a flat MEMORY_SIZE byte buffer.
+ */
+void memoryCopy(const Chip8 *sys, uint8_t *out) {
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    memcpy(out + page * MEMORY_PAGE_SIZE, sys->Pages[page]->Bytes,
+           MEMORY_PAGE_SIZE);
+  }
+}
+
+// One step of the hash: mix a word in.
+static inline uint64_t mixWord(uint64_t hash, uint64_t word) {
+  hash = (hash ^ word) * 0x9E3779B97F4A7C15;
+  return hash ^ (hash >> 29);
+}
+
+/**
+ * Mix bytes into a hash. Long runs (the display, a page) are hashed as four
+ * interleaved streams with a cheaper step so the multiplies don't wait on
+ * each other, and the streams are mixed in properly at the end.
+ *
+ * Parameters:
+ *  uint64_t hash: The hash so far.
+ *  const void* data: The bytes to add.
+ *  size_t size: The number of bytes.
+ * Returns:
+ *  uint64_t: The new hash.
+ */
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+
+  if (size >= 32) {
+    uint64_t a = hash, b = hash + 1, c = hash + 2, d = hash + 3;
+    for (; size >= 32; size -= 32, bytes += 32) {
+      uint64_t words[4];
+      memcpy(words, bytes, sizeof(words));
+      a = (a ^ words[0]) * 0x9E3779B97F4A7C15;
+      b = (b ^ words[1]) * 0x9E3779B97F4A7C15;
+      c = (c ^ words[2]) * 0x9E3779B97F4A7C15;
+      d = (d ^ words[3]) * 0x9E3779B97F4A7C15;
+    }
+    hash = mixWord(mixWord(mixWord(mixWord(hash, a), b), c), d);
+  }
+  while (size > 0) {
+    uint64_t word = 0;
+    size_t length = size < sizeof(word) ? size : sizeof(word);
+    memcpy(&word, bytes, length);
+    hash = mixWord(hash, word);
+    bytes += length;
+    size -= length;
+  }
+  return hash;
+}
+
+/**
+ * Hash all of memory. Page hashes are cached in the pages (which are write
+ * protected to keep them), so only pages written since they were last hashed
+ * are read.
+ *
+ * Returns:
+ *  uint64_t: The hash, equal for equal memory.
+ */
+uint64_t memoryHash(Chip8 *sys) {
+  uint64_t hash = 0;
+
+  for (int page = 0; page < MEMORY_PAGE_COUNT; page++) {
+    Chip8Page *at = sys->Pages[page];
+    uint64_t pageHash = __atomic_load_n(&at->Hash, __ATOMIC_RELAXED);
+    if (pageHash == 0) {
+      // 0 means not worked out yet.
+      pageHash = hashBytes(0xCBF29CE484222325, at->Bytes, MEMORY_PAGE_SIZE) | 1;
+      __atomic_store_n(&at->Hash, pageHash, __ATOMIC_RELAXED);
+      sys->Writable[page] = NULL;
+    }
+    hash = mixWord(hash, pageHash);
+  }
+  return hash;
+}
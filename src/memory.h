@@ -0,0 +1,109 @@
+/**
+ * Paged, copy-on-write memory.
+ *
+ * A machines 4K of memory is split into MEMORY_PAGE_COUNT reference counted
+ * pages. A fork (see chip8Fork) takes a reference to each of its parents
+ * pages instead of copying them, and whichever machine writes to a shared
+ * page first (FX33 or FX55, or loading a rom) gets its own copy of just that
+ * page. Reference counts are atomic, so forks of one machine can be run on
+ * different threads.
+ *
+ * Each page also caches a hash of its contents, which is kept for as long as
+ * the page isn't written and is shared along with the page, so hashing a
+ * fork only reads the pages it has written.
+ *
+ * Both work by write protecting pages: Writable[n] is NULL while page n is
+ * shared or hashed, and the first write to it then goes through
+ * memoryWritable to copy the page or drop its hash.
+ */
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define MEMORY_SIZE 4096
+#define MEMORY_PAGE_SIZE 256
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+
+typedef struct Chip8Page {
+  /**
+   * References: the number of machines using this page.
+   */
+  int References;
+
+  /**
+   * Hash: the hash of Bytes, 0 until it has been worked out.
+   */
+  uint64_t Hash;
+
+  uint8_t Bytes[MEMORY_PAGE_SIZE];
+} Chip8Page;
+
+int memoryInit(Chip8 *sys);
+void memoryFree(Chip8 *sys);
+void memoryFork(Chip8 *fork, Chip8 *sys);
+uint8_t *memoryWritable(Chip8 *sys, unsigned page);
+void memoryLoad(Chip8 *sys, uint16_t address, const uint8_t *data,
+                size_t size);
+void memoryClear(Chip8 *sys);
+void memoryCopy(const Chip8 *sys, uint8_t *out);
+uint64_t memoryHash(Chip8 *sys);
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+
+/**
+ * Read a byte of memory.
+ *
+ * Parameters:
+ *  const Chip8* sys: The system to read from.
+ *  uint16_t address: The address, must be below MEMORY_SIZE.
+ * Returns:
+ *  uint8_t: The byte at address.
+ */
+static inline uint8_t memoryRead(const Chip8 *sys, uint16_t address) {
+  return sys->Pages[address / MEMORY_PAGE_SIZE]
+      ->Bytes[address % MEMORY_PAGE_SIZE];
+}
+
+/**
+ * Read the big endian 16 bit opcode at an address, wrapping at 4K.
+ *
+ * Parameters:
+ *  const Chip8* sys: The system to read from.
+ *  uint16_t address: The address, must be below MEMORY_SIZE.
+ * Returns:
+ *  uint16_t: The opcode.
+ */
+static inline uint16_t memoryFetch(const Chip8 *sys, uint16_t address) {
+  unsigned page = address / MEMORY_PAGE_SIZE;
+  const uint8_t *bytes = sys->Pages[page]->Bytes + address % MEMORY_PAGE_SIZE;
+
+  // Only an opcode at the end of a page is split across two pages.
+  if (address % MEMORY_PAGE_SIZE != MEMORY_PAGE_SIZE - 1) {
+    return (bytes[0] << 8) | bytes[1];
+  }
+  return (bytes[0] << 8) | memoryRead(sys, (address + 1) % MEMORY_SIZE);
+}
+
+/**
+ * Write a byte of memory, copying its page first if it is shared. If there is
+ * no memory left for the copy the system faults and the write is dropped.
+ *
+ * Parameters:
+ *  Chip8* sys: The system to write to.
+ *  uint16_t address: The address, must be below MEMORY_SIZE.
+ *  uint8_t value: The byte to write.
+ */
+static inline void memoryWrite(Chip8 *sys, uint16_t address, uint8_t value) {
+  unsigned page = address / MEMORY_PAGE_SIZE;
+  uint8_t *bytes = sys->Writable[page];
+
+  if (bytes == NULL && (bytes = memoryWritable(sys, page)) == NULL) {
+    return;
+  }
+  bytes[address % MEMORY_PAGE_SIZE] = value;
+}
+
+#endif
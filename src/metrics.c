@@ -0,0 +1,302 @@
+/**
+ * Live metrics, see metrics.h.
+ */
+#include "metrics.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long the exporter sleeps at a time, so it notices being stopped.
+#define METRICS_POLL_MS 100
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The host clock in nanoseconds, for timing what is recorded.
+ */
+uint64_t metricsNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Create an empty set of metrics, not yet exported.
+ *
+ * Returns:
+ *  Chip8Metrics*: The metrics or NULL if they couldn't be allocated.
+ */
+Chip8Metrics *metricsCreate(void) {
+  Chip8Metrics *metrics = aligned_alloc(64, sizeof(Chip8Metrics));
+  if (metrics == NULL) {
+    return NULL;
+  }
+
+  memset(metrics, 0, sizeof(Chip8Metrics));
+  metrics->Listener = -1;
+  return metrics;
+}
+
+/**
+ * Take a shard for the calling thread to record into. Only that thread may
+ * record into it.
+ *
+ * Returns:
+ *  Chip8MetricsShard*: The shard or NULL if METRICS_MAX_THREADS have been
+ *                      taken.
+ */
+Chip8MetricsShard *metricsShard(Chip8Metrics *metrics) {
+  int shard = atomic_fetch_add(&metrics->ShardCount, 1);
+  if (shard >= METRICS_MAX_THREADS) {
+    return NULL;
+  }
+  return &metrics->Shards[shard];
+}
+
+static uint64_t load(_Atomic uint64_t *value) {
+  return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+/**
+ * Write one of chip8Histograms added up over the first shards shards, with
+ * cumulative buckets as Prometheus expects.
+ */
+static void writeHistogram(Chip8Metrics *metrics, int shards, FILE *out,
+                           int histogram, const char *name, const char *help,
+                           int shift, double scale) {
+  uint64_t count = 0;
+  uint64_t sum = 0;
+
+  fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+  for (int b = 0; b < METRICS_BUCKETS; b++) {
+    for (int s = 0; s < shards; s++) {
+      count += load(&metrics->Shards[s].Histograms[histogram].Buckets[b]);
+    }
+    if (b < METRICS_BUCKETS - 1) {
+      fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", name,
+              (double)(1ull << (shift + b)) * scale, (unsigned long long)count);
+    }
+  }
+  for (int s = 0; s < shards; s++) {
+    sum += load(&metrics->Shards[s].Histograms[histogram].Sum);
+  }
+  fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n", name,
+          (unsigned long long)count, name, sum * scale, name,
+          (unsigned long long)count);
+}
+
+/**
+ * Write the totals of every shard in the Prometheus text format. Shards are
+ * read while being written, so a histogram's buckets may be a frame apart.
+ * Call from one thread at a time (the exporter while exporting).
+ *
+ * Parameters:
+ *  Chip8Metrics* metrics: The metrics.
+ *  FILE* out: Where to write.
+ */
+void metricsWrite(Chip8Metrics *metrics, FILE *out) {
+  int shards = atomic_load(&metrics->ShardCount);
+  if (shards > METRICS_MAX_THREADS) {
+    shards = METRICS_MAX_THREADS;
+  }
+
+  uint64_t counters[METRIC_COUNTER_COUNT] = {0};
+  for (int s = 0; s < shards; s++) {
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+      counters[c] += load(&metrics->Shards[s].Counters[c]);
+    }
+  }
+
+#define WRITE_COUNTER(id, name, help)                                          \
+  fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, \
+          name, (unsigned long long)counters[METRIC_##id]);
+  METRICS_COUNTERS(WRITE_COUNTER)
+#undef WRITE_COUNTER
+
+  // Instructions per second since the last write, kept from the last one if
+  // they are too close together to say.
+  double time = now();
+  uint64_t instructions = counters[METRIC_INSTRUCTIONS];
+  if (metrics->LastTime == 0 || time - metrics->LastTime >= 0.1) {
+    if (metrics->LastTime != 0) {
+      metrics->Rate = (instructions - metrics->LastInstructions) /
+                      (time - metrics->LastTime);
+    }
+    metrics->LastInstructions = instructions;
+    metrics->LastTime = time;
+  }
+  fprintf(out,
+          "# HELP chip8_instructions_per_second Instructions run per second "
+          "recently.\n# TYPE chip8_instructions_per_second gauge\n"
+          "chip8_instructions_per_second %.0f\n",
+          metrics->Rate);
+
+#define WRITE_HISTOGRAM(id, name, help, shift, scale)                          \
+  writeHistogram(metrics, shards, out, METRIC_##id, name, help, shift, scale);
+  METRICS_HISTOGRAMS(WRITE_HISTOGRAM)
+#undef WRITE_HISTOGRAM
+}
+
+/**
+ * Write the stats file, through a temporary file so it is replaced whole.
+ */
+static void writeFile(Chip8Metrics *metrics) {
+  size_t length = strlen(metrics->FilePath);
+  char *temporary = malloc(length + sizeof(".tmp"));
+  if (temporary == NULL) {
+    return;
+  }
+  memcpy(temporary, metrics->FilePath, length);
+  memcpy(temporary + length, ".tmp", sizeof(".tmp"));
+
+  FILE *fp = fopen(temporary, "w");
+  if (fp != NULL) {
+    metricsWrite(metrics, fp);
+    fclose(fp);
+    rename(temporary, metrics->FilePath);
+  }
+  free(temporary);
+}
+
+/**
+ * Answer a client of the socket with the metrics and hang up. They are
+ * rendered first and sent without SIGPIPE, so a scraper hanging up early
+ * can't take the host down with it.
+ */
+static void answerClient(Chip8Metrics *metrics, int client) {
+  char *text = NULL;
+  size_t size = 0;
+  FILE *fp = open_memstream(&text, &size);
+  if (fp != NULL) {
+    metricsWrite(metrics, fp);
+    fclose(fp);
+
+    size_t pos = 0;
+    while (pos < size) {
+      ssize_t sent = send(client, text + pos, size - pos, MSG_NOSIGNAL);
+      if (sent < 0 && errno != EINTR) {
+        break;
+      }
+      pos += sent > 0 ? sent : 0;
+    }
+    free(text);
+  }
+  close(client);
+}
+
+/**
+ * The exporter thread: rewrites the stats file every METRICS_INTERVAL and
+ * answers each client of the socket, until stopped.
+ */
+static void *exportMetrics(void *arg) {
+  Chip8Metrics *metrics = arg;
+  double next = now();
+
+  while (!atomic_load(&metrics->Stopping)) {
+    if (metrics->FilePath != NULL && now() >= next) {
+      writeFile(metrics);
+      next += METRICS_INTERVAL;
+    }
+
+    // A negative fd is ignored, so without a socket this only sleeps.
+    struct pollfd listener = {metrics->Listener, POLLIN, 0};
+    if (poll(&listener, 1, METRICS_POLL_MS) > 0 &&
+        (listener.revents & POLLIN)) {
+      int client = accept(metrics->Listener, NULL, NULL);
+      if (client >= 0) {
+        answerClient(metrics, client);
+      }
+    }
+  }
+
+  // Leave the final totals behind.
+  if (metrics->FilePath != NULL) {
+    writeFile(metrics);
+  }
+  return NULL;
+}
+
+/**
+ * Open a unix socket for the exporter to answer.
+ *
+ * Returns:
+ *  int: The listening socket or -1 on error.
+ */
+static int listenOn(const char *socketPath) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, socketPath);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return -1;
+  }
+  unlink(socketPath);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 4) != 0) {
+    close(listener);
+    return -1;
+  }
+  return listener;
+}
+
+/**
+ * Start exporting to a stats file, a unix socket or both.
+ *
+ * Parameters:
+ *  Chip8Metrics* metrics: The metrics.
+ *  const char* filePath: The stats file to rewrite or NULL.
+ *  const char* socketPath: The unix socket to serve on or NULL.
+ * Returns:
+ *  int: 0 on success, -1 if the socket couldn't be opened.
+ */
+int metricsExport(Chip8Metrics *metrics, const char *filePath,
+                  const char *socketPath) {
+  if (socketPath != NULL) {
+    metrics->Listener = listenOn(socketPath);
+    if (metrics->Listener < 0) {
+      return -1;
+    }
+    metrics->SocketPath = strdup(socketPath);
+  }
+  if (filePath != NULL) {
+    metrics->FilePath = strdup(filePath);
+  }
+
+  if (pthread_create(&metrics->Exporter, NULL, exportMetrics, metrics) != 0) {
+    return -1;
+  }
+  metrics->Exporting = 1;
+  return 0;
+}
+
+/**
+ * Stop exporting, writing the stats file a last time, and free the metrics.
+ */
+void metricsDestroy(Chip8Metrics *metrics) {
+  if (metrics->Exporting) {
+    atomic_store(&metrics->Stopping, 1);
+    pthread_join(metrics->Exporter, NULL);
+  }
+  if (metrics->Listener >= 0) {
+    close(metrics->Listener);
+    unlink(metrics->SocketPath);
+  }
+  free(metrics->SocketPath);
+  free(metrics->FilePath);
+  free(metrics);
+}
@@ -0,0 +1,148 @@
+/**
+ * Live metrics: counters and histograms of how the interpreter is running,
+ * exported in the Prometheus text format.
+ *
+ * Each thread that records takes its own Chip8MetricsShard and is the only
+ * writer of it, so recording is a relaxed load and store with no locks,
+ * atomic read-modify-writes or syscalls. Nothing is recorded per instruction:
+ * the host loop counts instructions in a local and records once a frame.
+ *
+ * An exporter thread adds up the shards every METRICS_INTERVAL seconds and
+ * rewrites a stats file (replaced with a rename so readers never see half of
+ * it), and/or serves the same text to each client that connects to a unix
+ * socket, e.g. `socat - UNIX-CONNECT:path`.
+ *
+ * Histogram bucket n counts values <= 2^(Shift + n) units, the last bucket
+ * is +Inf. Times are recorded in nanoseconds and exported in seconds.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define METRICS_MAX_THREADS 16
+#define METRICS_BUCKETS 26
+
+// How often the stats file is rewritten, in seconds.
+#define METRICS_INTERVAL 1.0
+
+// The counters: X(id, name, help).
+#define METRICS_COUNTERS(X)                                                    \
+  X(INSTRUCTIONS, "chip8_instructions_total", "Instructions run.")             \
+  X(CYCLES, "chip8_cycles_total", "Cycles run, see the profile.")              \
+  X(FRAMES, "chip8_frames_total", "60hz frames run.")                          \
+  X(DROPPED_FRAMES, "chip8_dropped_frames_total",                              \
+    "Frames presented more than a frame late.")
+
+// The histograms: X(id, name, help, shift, scale to export units).
+#define METRICS_HISTOGRAMS(X)                                                  \
+  X(FRAME_CYCLES, "chip8_frame_cycles", "Cycles run per frame.", 0, 1)         \
+  X(RENDER, "chip8_render_seconds", "Time drawing a frame.", 10, 1e-9)         \
+  X(PRESENT, "chip8_present_seconds", "Time presenting a frame.", 10, 1e-9)    \
+  X(INPUT_LATENCY, "chip8_input_latency_seconds",                              \
+    "Time from a key changing to the next frame presented.", 10, 1e-9)         \
+  X(WAIT, "chip8_wait_seconds", "Time waiting for the next frame.", 10, 1e-9)
+
+#define METRICS_ENUM(id, ...) METRIC_##id,
+enum chip8Counters { METRICS_COUNTERS(METRICS_ENUM) METRIC_COUNTER_COUNT };
+enum chip8Histograms {
+  METRICS_HISTOGRAMS(METRICS_ENUM) METRIC_HISTOGRAM_COUNT
+};
+#undef METRICS_ENUM
+
+typedef struct Chip8Histogram {
+  _Atomic uint64_t Buckets[METRICS_BUCKETS];
+  _Atomic uint64_t Sum;
+} Chip8Histogram;
+
+/**
+ * One thread's counters and histograms. Cache line aligned so that threads
+ * recording at once never share a line.
+ */
+typedef struct Chip8MetricsShard {
+  _Atomic uint64_t Counters[METRIC_COUNTER_COUNT];
+  Chip8Histogram Histograms[METRIC_HISTOGRAM_COUNT];
+} __attribute__((aligned(64))) Chip8MetricsShard;
+
+typedef struct Chip8Metrics {
+  Chip8MetricsShard Shards[METRICS_MAX_THREADS];
+  _Atomic int ShardCount;
+
+  /**
+   * Export: where to, the exporter thread and the flag that stops it.
+   */
+  char *FilePath;
+  int Listener;
+  char *SocketPath;
+  pthread_t Exporter;
+  int Exporting;
+  _Atomic int Stopping;
+
+  /**
+   * The instructions and host time at the last export, for the rate.
+   */
+  uint64_t LastInstructions;
+  double LastTime;
+  double Rate;
+} Chip8Metrics;
+
+Chip8Metrics *metricsCreate(void);
+int metricsExport(Chip8Metrics *metrics, const char *filePath,
+                  const char *socketPath);
+void metricsDestroy(Chip8Metrics *metrics);
+Chip8MetricsShard *metricsShard(Chip8Metrics *metrics);
+void metricsWrite(Chip8Metrics *metrics, FILE *out);
+uint64_t metricsNow(void);
+
+/**
+ * Add n to one of chip8Counters, only from the thread that owns shard.
+ */
+static inline void metricsAdd(Chip8MetricsShard *shard, int counter,
+                              uint64_t n) {
+  _Atomic uint64_t *c = &shard->Counters[counter];
+  atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                        memory_order_relaxed);
+}
+
+/**
+ * The shift of one of chip8Histograms, see the top of this file.
+ */
+static inline int metricsShift(int histogram) {
+  switch (histogram) {
+#define METRICS_SHIFT(id, name, help, shift, scale)                            \
+  case METRIC_##id:                                                            \
+    return shift;
+    METRICS_HISTOGRAMS(METRICS_SHIFT)
+#undef METRICS_SHIFT
+  }
+  return 0;
+}
+
+/**
+ * Record a value in one of chip8Histograms, only from the thread that owns
+ * shard.
+ */
+static inline void metricsObserve(Chip8MetricsShard *shard, int histogram,
+                                  uint64_t value) {
+  Chip8Histogram *h = &shard->Histograms[histogram];
+  int shift = metricsShift(histogram);
+  int bucket = 0;
+  if (value > (1ull << shift)) {
+    bucket = 64 - __builtin_clzll(value - 1) - shift;
+  }
+  if (bucket >= METRICS_BUCKETS) {
+    bucket = METRICS_BUCKETS - 1;
+  }
+
+  _Atomic uint64_t *b = &h->Buckets[bucket];
+  atomic_store_explicit(b, atomic_load_explicit(b, memory_order_relaxed) + 1,
+                        memory_order_relaxed);
+  atomic_store_explicit(
+      &h->Sum, atomic_load_explicit(&h->Sum, memory_order_relaxed) + value,
+      memory_order_relaxed);
+}
+
+#endif
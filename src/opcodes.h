@@ -0,0 +1,53 @@
+/**
+ * The instruction set as cycleSystem decodes it, shared by the disassembler
+ * (and through it the analysis) so neither treats an opcode differently from
+ * the interpreter.
+ *
+ * X(mask, match, format, operands...): an opcode is the instruction whose
+ * match equals opcode & mask, written as format (Cowgod style assembly) with
+ * the operands named, each one of x, y, n, nn or nnn (the fields of 0x_xyn
+ * and 0x_nnn). Bits outside the mask are ignored by the interpreter too,
+ * e.g. the n of 5xyn and 9xyn. Every case of executeInstruction (and of the
+ * batch's vector decoder) that runs an instruction has an entry here; an
+ * opcode with none is unknown and stops the machine where it is.
+ */
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#define CHIP8_OPCODES(X)                                                       \
+  X(0xFFFF, 0x00E0, "CLS")                                                     \
+  X(0xFFFF, 0x00EE, "RET")                                                     \
+  X(0xF000, 0x1000, "JP   0x%03X", nnn)                                        \
+  X(0xF000, 0x2000, "CALL 0x%03X", nnn)                                        \
+  X(0xF000, 0x3000, "SE   V%X, 0x%02X", x, nn)                                 \
+  X(0xF000, 0x4000, "SNE  V%X, 0x%02X", x, nn)                                 \
+  X(0xF000, 0x5000, "SE   V%X, V%X", x, y)                                     \
+  X(0xF000, 0x6000, "LD   V%X, 0x%02X", x, nn)                                 \
+  X(0xF000, 0x7000, "ADD  V%X, 0x%02X", x, nn)                                 \
+  X(0xF00F, 0x8000, "LD   V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8001, "OR   V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8002, "AND  V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8003, "XOR  V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8004, "ADD  V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8005, "SUB  V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8006, "SHR  V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x8007, "SUBN V%X, V%X", x, y)                                     \
+  X(0xF00F, 0x800E, "SHL  V%X, V%X", x, y)                                     \
+  X(0xF000, 0x9000, "SNE  V%X, V%X", x, y)                                     \
+  X(0xF000, 0xA000, "LD   I, 0x%03X", nnn)                                     \
+  X(0xF000, 0xB000, "JP   V0, 0x%03X", nnn)                                    \
+  X(0xF000, 0xC000, "RND  V%X, 0x%02X", x, nn)                                 \
+  X(0xF000, 0xD000, "DRW  V%X, V%X, %u", x, y, n)                              \
+  X(0xF0FF, 0xE09E, "SKP  V%X", x)                                             \
+  X(0xF0FF, 0xE0A1, "SKNP V%X", x)                                             \
+  X(0xF0FF, 0xF007, "LD   V%X, DT", x)                                         \
+  X(0xF0FF, 0xF00A, "LD   V%X, K", x)                                          \
+  X(0xF0FF, 0xF015, "LD   DT, V%X", x)                                         \
+  X(0xF0FF, 0xF018, "LD   ST, V%X", x)                                         \
+  X(0xF0FF, 0xF01E, "ADD  I, V%X", x)                                          \
+  X(0xF0FF, 0xF029, "LD   F, V%X", x)                                          \
+  X(0xF0FF, 0xF033, "LD   B, V%X", x)                                          \
+  X(0xF0FF, 0xF055, "LD   [I], V%X", x)                                        \
+  X(0xF0FF, 0xF065, "LD   V%X, [I]", x)
+
+#endif
@@ -9,38 +9,72 @@
  */
 #include "peripheral.h"
 #include <SDL2/SDL.h>
+#include <SDL2/SDL_audio.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_keyboard.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_video.h>
 #include <stdio.h>
 
+// The beep: a square wave of BEEP_HZ, played while the device is unpaused.
+#define BEEP_RATE 44100
+#define BEEP_HZ 440
+#define BEEP_VOLUME 3000
+
 // To move potentially
 SDL_Window *screen;
 SDL_Renderer *renderer;
+SDL_AudioDeviceID audio;
+
+/**
+ * Fill an audio buffer with the beep, called by SDL while it is playing.
+ */
+static void fillBeep(void *userdata, Uint8 *stream, int length) {
+  static unsigned phase;
+  Sint16 *samples = (Sint16 *)stream;
+
+  (void)userdata;
+  for (int i = 0; i < length / (int)sizeof(Sint16); i++) {
+    samples[i] = (phase++ / (BEEP_RATE / BEEP_HZ / 2)) % 2 ? BEEP_VOLUME
+                                                           : -BEEP_VOLUME;
+  }
+}
 
 /**
  * Initialise the display window.
  */
 void displayInit(void) {
-  SDL_Init(SDL_INIT_VIDEO);
+  SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
   screen = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_CENTERED,
                             SDL_WINDOWPOS_CENTERED, 64 * 16, 32 * 16, 0);
   renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED);
+
+  // Without an audio device the beep is silent, 0 is never a device.
+  SDL_AudioSpec spec;
+  SDL_zero(spec);
+  spec.freq = BEEP_RATE;
+  spec.format = AUDIO_S16SYS;
+  spec.channels = 1;
+  spec.samples = 512;
+  spec.callback = fillBeep;
+  audio = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
 }
 
 /*
  * Quit SDL and destroy the screen and renderer.
  */
 void displayQuit(void) {
+  if (audio != 0) {
+    SDL_CloseAudioDevice(audio);
+  }
   SDL_DestroyWindow(screen);
   SDL_DestroyRenderer(renderer);
   SDL_Quit();
 }
 
 /**
- * Update the window to the current state of the system.
+ * Draw the current state of the system, shown on the next present.
  * Parameters:
  *  Chip8* sys: the chip8 "system"
  */
@@ -68,7 +102,23 @@ void draw(Chip8 *sys) {
       }
     }
   }
-  SDL_RenderPresent(renderer);
+}
+
+/**
+ * Show what was last drawn in the window.
+ */
+void present(void) { SDL_RenderPresent(renderer); }
+
+/**
+ * Start or stop the beep.
+ *
+ * Parameters:
+ *  int on: 1 to start it, 0 to stop it.
+ */
+void beep(int on) {
+  if (audio != 0) {
+    SDL_PauseAudioDevice(audio, !on);
+  }
 }
 
 /**
@@ -117,9 +167,12 @@ SDL_Scancode keys[16] = {
  *
  * Parameters:
  *  Chip8* sys: The current state of the system.
+ * Returns:
+ *  int: 1 if a key changed, otherwise 0.
  */
-void handleEvents(Chip8 *sys) {
+int handleEvents(Chip8 *sys) {
   SDL_Event event;
+  int changed = 0;
 
   const Uint8 *keyState = SDL_GetKeyboardState(NULL);
   // If an event has happened
@@ -127,18 +180,20 @@ void handleEvents(Chip8 *sys) {
     // If user quits set sys->Quit and return.
     if (SDL_QUIT == event.type) {
       sys->Quit = 1;
-      return;
+      return 0;
     }
     // If escape key is pressed set sys->Quit and return.
     if (keyState[SDL_SCANCODE_ESCAPE]) {
       sys->Quit = 1;
-      return;
+      return 0;
     }
 
     // For each key in the defined key map (see sys->Keyboard) set the state
     // stored in sys to match the current state.
     for (int keyCode = 0; keyCode < 16; keyCode++) {
+      changed |= sys->Keyboard[keyCode] != keyState[keys[keyCode]];
       sys->Keyboard[keyCode] = keyState[keys[keyCode]];
     }
   }
+  return changed;
 }
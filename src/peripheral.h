@@ -6,7 +6,9 @@
 void displayInit(void);
 void displayQuit(void);
 void draw(Chip8 *sys);
+void present(void);
+void beep(int on);
 void printDisplay(Chip8 *sys);
-void handleEvents(Chip8 *sys);
+int handleEvents(Chip8 *sys);
 void printKeyboard(Chip8 *sys);
 #endif
@@ -0,0 +1,382 @@
+/**
+ * Session recording and replay verification, see record.h for the format.
+ */
+#include "record.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// A keys record after its type.
+#define RECORD_KEYS_SIZE 10
+// A checkpoint record after its type, without the snapshot.
+#define RECORD_CHECKPOINT_SIZE 16
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put32(uint8_t *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = value >> (i * 8);
+  }
+}
+
+static void put64(uint8_t *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = value >> (i * 8);
+  }
+}
+
+static uint64_t get(const uint8_t *in, int size) {
+  uint64_t value = 0;
+  for (int i = 0; i < size; i++) {
+    value |= (uint64_t)in[i] << (i * 8);
+  }
+  return value;
+}
+
+/**
+ * Write a checkpoint of the machine as it is now.
+ */
+static void writeCheckpoint(Chip8Recorder *rec, Chip8 *sys) {
+  uint8_t record[1 + RECORD_CHECKPOINT_SIZE];
+  record[0] = RECORD_CHECKPOINT;
+  put64(record + 1, rec->Frame);
+  put64(record + 9, sys->Cycles);
+
+  chip8Snapshot(sys, rec->Snapshot);
+  fwrite(record, 1, sizeof(record), rec->fp);
+  fwrite(rec->Snapshot, 1, chip8SnapshotSize(), rec->fp);
+  rec->LastCheckpoint = sys->Cycles;
+  rec->Checkpoints++;
+}
+
+/**
+ * Start recording a session, from a first checkpoint of the machine now.
+ *
+ * Parameters:
+ *  Chip8* sys: The machine.
+ *  const char* filePath: Where to write the recording.
+ *  uint32_t interval: The frames between checkpoints, e.g. RECORD_INTERVAL.
+ * Returns:
+ *  Chip8Recorder*: The recorder or NULL if the file couldn't be opened.
+ */
+Chip8Recorder *recordOpen(Chip8 *sys, const char *filePath,
+                          uint32_t interval) {
+  Chip8Recorder *rec = calloc(1, sizeof(Chip8Recorder));
+  if (rec == NULL) {
+    return NULL;
+  }
+
+  rec->Snapshot = malloc(chip8SnapshotSize());
+  rec->fp = fopen(filePath, "wb");
+  if (rec->Snapshot == NULL || rec->fp == NULL) {
+    if (rec->fp != NULL) {
+      fclose(rec->fp);
+    }
+    free(rec->Snapshot);
+    free(rec);
+    return NULL;
+  }
+  rec->Interval = interval > 0 ? interval : 1;
+
+  uint8_t header[16] = {RECORD_MAGIC[0], RECORD_MAGIC[1], RECORD_MAGIC[2],
+                        RECORD_MAGIC[3], RECORD_VERSION};
+  put32(header + 8, chip8SnapshotSize());
+  put32(header + 12, rec->Interval);
+  fwrite(header, 1, sizeof(header), rec->fp);
+  writeCheckpoint(rec, sys);
+  return rec;
+}
+
+/**
+ * Record the keys, call whenever they change.
+ */
+void recordInput(Chip8Recorder *rec, const Chip8 *sys) {
+  uint16_t keys = 0;
+  for (int key = 0; key < 16; key++) {
+    keys |= (sys->Keyboard[key] & 1) << key;
+  }
+
+  uint8_t record[1 + RECORD_KEYS_SIZE];
+  record[0] = RECORD_KEYS;
+  put64(record + 1, sys->Cycles);
+  record[9] = keys & 0xFF;
+  record[10] = keys >> 8;
+  fwrite(record, 1, sizeof(record), rec->fp);
+}
+
+/**
+ * Count a frame, call at the end of each one. Writes a checkpoint every
+ * Interval frames.
+ */
+void recordFrame(Chip8Recorder *rec, Chip8 *sys) {
+  rec->Frame++;
+  if (rec->Frame % rec->Interval == 0) {
+    writeCheckpoint(rec, sys);
+  }
+}
+
+/**
+ * Write the last checkpoint and close the recording.
+ */
+void recordClose(Chip8Recorder *rec, Chip8 *sys) {
+  if (sys->Cycles != rec->LastCheckpoint) {
+    // The host quitting isn't something a replay does, faults are.
+    int quit = sys->Quit;
+    sys->Quit = sys->Fault != CHIP8_FAULT_NONE;
+    writeCheckpoint(rec, sys);
+    sys->Quit = quit;
+  }
+  fclose(rec->fp);
+  free(rec->Snapshot);
+  free(rec);
+}
+
+typedef struct RecordedKeys {
+  uint64_t Cycle;
+  uint16_t Keys;
+} RecordedKeys;
+
+typedef struct Checkpoint {
+  uint64_t Frame;
+  uint64_t Cycle;
+  const uint8_t *Snapshot;
+  size_t FirstKeys; // The first keys record after it.
+} Checkpoint;
+
+/**
+ * A recording read back for verifying, shared by the replay threads.
+ */
+typedef struct Recording {
+  uint8_t *Data;
+  size_t SnapshotSize;
+  Checkpoint *Checkpoints;
+  size_t CheckpointCount;
+  RecordedKeys *Keys;
+  size_t KeyCount;
+
+  // The next segment for a thread to take, and those that didn't match.
+  _Atomic size_t NextSegment;
+  uint8_t *Failed;
+} Recording;
+
+/**
+ * Read a recording and index its checkpoints and keys.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the file can't be read (including from a pipe,
+ *       which can't be sized), isn't a recording or there isn't the memory.
+ */
+static int readRecording(Recording *recording, const char *filePath) {
+  memset(recording, 0, sizeof(Recording));
+  FILE *fp = fopen(filePath, "rb");
+  if (fp == NULL) {
+    return -1;
+  }
+  long size = -1;
+  if (fseek(fp, 0, SEEK_END) == 0) {
+    size = ftell(fp);
+  }
+  if (size < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    return -1;
+  }
+
+  recording->Data = malloc(size > 0 ? size : 1);
+  if (recording->Data == NULL) {
+    fclose(fp);
+    return -1;
+  }
+  size = fread(recording->Data, 1, size, fp);
+  fclose(fp);
+
+  const uint8_t *data = recording->Data;
+  if (size < 16 || memcmp(data, RECORD_MAGIC, 4) != 0 ||
+      get(data + 4, 2) != RECORD_VERSION ||
+      get(data + 8, 4) != chip8SnapshotSize()) {
+    return -1;
+  }
+  recording->SnapshotSize = get(data + 8, 4);
+
+  // Every record is at least as long as a keys record.
+  size_t most = size / (1 + RECORD_KEYS_SIZE) + 1;
+  recording->Checkpoints = malloc(most * sizeof(Checkpoint));
+  recording->Keys = malloc(most * sizeof(RecordedKeys));
+  if (recording->Checkpoints == NULL || recording->Keys == NULL) {
+    return -1;
+  }
+
+  // Replays start from a checkpoint, so keys before the first have no state
+  // to apply to: a recording that doesn't start with one is broken.
+  if (size > 16 && data[16] != RECORD_CHECKPOINT) {
+    return -1;
+  }
+  for (long pos = 16; pos < size;) {
+    long left = size - pos - 1;
+    if (data[pos] == RECORD_KEYS && left >= RECORD_KEYS_SIZE) {
+      RecordedKeys *keys = &recording->Keys[recording->KeyCount++];
+      keys->Cycle = get(data + pos + 1, 8);
+      keys->Keys = get(data + pos + 9, 2);
+      pos += 1 + RECORD_KEYS_SIZE;
+    } else if (data[pos] == RECORD_CHECKPOINT &&
+               left >= (long)(RECORD_CHECKPOINT_SIZE +
+                              recording->SnapshotSize)) {
+      Checkpoint *checkpoint =
+          &recording->Checkpoints[recording->CheckpointCount++];
+      checkpoint->Frame = get(data + pos + 1, 8);
+      checkpoint->Cycle = get(data + pos + 9, 8);
+      checkpoint->Snapshot = data + pos + 1 + RECORD_CHECKPOINT_SIZE;
+      checkpoint->FirstKeys = recording->KeyCount;
+      pos += 1 + RECORD_CHECKPOINT_SIZE + recording->SnapshotSize;
+    } else {
+      // Cut short, e.g. the host crashed: verify what was written.
+      break;
+    }
+  }
+  return recording->CheckpointCount > 0 ? 0 : -1;
+}
+
+static void freeRecording(Recording *recording) {
+  free(recording->Data);
+  free(recording->Checkpoints);
+  free(recording->Keys);
+  free(recording->Failed);
+}
+
+/**
+ * Replay segment n of a recording on sys.
+ *
+ * Returns:
+ *  int: 1 if it ends in exactly the next checkpoint's state, otherwise 0.
+ */
+static int replaySegment(Recording *recording, Chip8 *sys, void *snapshot,
+                         size_t n) {
+  const Checkpoint *start = &recording->Checkpoints[n];
+  const Checkpoint *end = &recording->Checkpoints[n + 1];
+  size_t keys = start->FirstKeys;
+
+  if (chip8Restore(sys, start->Snapshot) != 0) {
+    return 0;
+  }
+  while (1) {
+    // Keys change after the instruction that reached their cycle, or before
+    // the first one if they changed at the checkpoint's cycle.
+    while (keys < end->FirstKeys &&
+           recording->Keys[keys].Cycle <= sys->Cycles) {
+      chip8SetKeys(sys, recording->Keys[keys++].Keys);
+    }
+    if (sys->Cycles >= end->Cycle || sys->Quit) {
+      break;
+    }
+    cycleSystem(sys);
+  }
+
+  chip8Snapshot(sys, snapshot);
+  return memcmp(snapshot, end->Snapshot, recording->SnapshotSize) == 0;
+}
+
+/**
+ * A replay thread, takes segments until there are none left. Without the
+ * memory for a machine it takes none and leaves them to the other threads.
+ */
+static void *replaySegments(void *arg) {
+  Recording *recording = arg;
+  Chip8 *sys = chip8Create();
+  void *snapshot = malloc(recording->SnapshotSize);
+  if (sys == NULL || snapshot == NULL) {
+    free(snapshot);
+    if (sys != NULL) {
+      chip8Destroy(sys);
+    }
+    return NULL;
+  }
+
+  size_t n;
+  while ((n = atomic_fetch_add(&recording->NextSegment, 1)) <
+         recording->CheckpointCount - 1) {
+    recording->Failed[n] = !replaySegment(recording, sys, snapshot, n);
+  }
+
+  free(snapshot);
+  chip8Destroy(sys);
+  return NULL;
+}
+
+/**
+ * Replay every segment of a recording on threads threads, and print which
+ * (if any) didn't end in the next checkpoint's state.
+ *
+ * Parameters:
+ *  const char* filePath: The recording.
+ *  int threads: How many segments to replay at once.
+ *  FILE* out: Where to print the result.
+ * Returns:
+ *  int: The number of segments that didn't match (or couldn't be replayed),
+ *       or -1 if the recording couldn't be read.
+ */
+int recordVerify(const char *filePath, int threads, FILE *out) {
+  Recording recording;
+  if (readRecording(&recording, filePath) != 0) {
+    freeRecording(&recording);
+    return -1;
+  }
+
+  size_t segments = recording.CheckpointCount - 1;
+  if (threads < 1) {
+    threads = 1;
+  }
+  recording.Failed = malloc(segments + 1);
+  pthread_t *workers = malloc(threads * sizeof(pthread_t));
+  if (recording.Failed == NULL || workers == NULL) {
+    free(workers);
+    freeRecording(&recording);
+    return -1;
+  }
+  // Until replayed a segment counts as differing, so any no thread could
+  // take are reported rather than passed.
+  memset(recording.Failed, 1, segments + 1);
+
+  double start = now();
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, replaySegments, &recording) ==
+        0) {
+      started++;
+    }
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  double elapsed = now() - start;
+
+  int failed = 0;
+  for (size_t n = 0; n < segments; n++) {
+    if (recording.Failed[n]) {
+      const Checkpoint *from = &recording.Checkpoints[n];
+      const Checkpoint *to = &recording.Checkpoints[n + 1];
+      fprintf(out,
+              "Segment %zu (frames %llu-%llu, cycles %llu-%llu) differs.\n", n,
+              (unsigned long long)from->Frame, (unsigned long long)to->Frame,
+              (unsigned long long)from->Cycle, (unsigned long long)to->Cycle);
+      failed++;
+    }
+  }
+
+  const Checkpoint *last = &recording.Checkpoints[segments];
+  fprintf(out,
+          "%zu segments, %llu frames, %llu cycles replayed on %i threads in "
+          "%.3fs: %i differ.\n",
+          segments, (unsigned long long)last->Frame,
+          (unsigned long long)(last->Cycle - recording.Checkpoints[0].Cycle),
+          started, elapsed, failed);
+
+  free(workers);
+  freeRecording(&recording);
+  return failed;
+}
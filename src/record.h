@@ -0,0 +1,66 @@
+/**
+ * Session recording and parallel replay verification.
+ *
+ * A recording is the input log of a session with a full snapshot of the
+ * machine (a checkpoint) every Interval frames and at the end. Everything
+ * else the machine does follows from its state, so the stretch between two
+ * checkpoints (a segment) can be replayed on its own: restore the first
+ * checkpoint, run to the next one's cycle applying the recorded keys, and
+ * the state must match the next checkpoint exactly. recordVerify replays
+ * every segment at once on a pool of threads, so checking a long session
+ * takes about its length / threads, and a failing segment pins down where
+ * a change in the interpreter first made a difference.
+ *
+ * The host must call recordInput whenever it changes the keys and
+ * recordFrame at the end of every frame, in the order they happen.
+ * Anything else that changes the machine (the debugger) isn't recorded.
+ *
+ * File format (all values little endian):
+ *  Header: "C8RC", uint16 version, uint16 reserved, uint32 snapshot size,
+ *          uint32 interval in frames.
+ *  Records: uint8 type, then
+ *   - RECORD_KEYS: uint64 cycle, uint16 keys (bit n is key n). The keys
+ *     changed after the instruction that brought Cycles to cycle.
+ *   - RECORD_CHECKPOINT: uint64 frame, uint64 cycle, then a snapshot (see
+ *     chip8Snapshot) of snapshot size bytes.
+ *  The first record is a checkpoint, as is the last. Keys records belong to
+ *  the segment after the checkpoint before them.
+ */
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+#define RECORD_MAGIC "C8RC"
+#define RECORD_VERSION 1
+
+// Record types.
+#define RECORD_KEYS 1
+#define RECORD_CHECKPOINT 2
+
+// The default frames between checkpoints, 10 seconds.
+#define RECORD_INTERVAL 600
+
+typedef struct Chip8Recorder {
+  FILE *fp;
+  void *Snapshot;
+  uint32_t Interval;
+
+  /**
+   * The frames seen, and the cycle of the last checkpoint written.
+   */
+  uint64_t Frame;
+  uint64_t LastCheckpoint;
+  uint64_t Checkpoints;
+} Chip8Recorder;
+
+Chip8Recorder *recordOpen(Chip8 *sys, const char *filePath, uint32_t interval);
+void recordInput(Chip8Recorder *rec, const Chip8 *sys);
+void recordFrame(Chip8Recorder *rec, Chip8 *sys);
+void recordClose(Chip8Recorder *rec, Chip8 *sys);
+int recordVerify(const char *filePath, int threads, FILE *out);
+
+#endif
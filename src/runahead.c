@@ -0,0 +1,94 @@
+/**
+ * Run-ahead, see runahead.h.
+ */
+#include "runahead.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Create a run-ahead for a machine.
+ *
+ * Parameters:
+ *  Chip8* sys: The live machine.
+ *  int frames: How many frames ahead to show, at least 1.
+ * Returns:
+ *  Chip8RunAhead*: The run-ahead or NULL if it couldn't be allocated.
+ */
+Chip8RunAhead *runAheadCreate(Chip8 *sys, int frames) {
+  Chip8RunAhead *ra = calloc(1, sizeof(Chip8RunAhead));
+  if (ra == NULL) {
+    return NULL;
+  }
+
+  ra->Sys = sys;
+  ra->Frames = frames;
+  ra->Ahead = chip8Create();
+  ra->Snapshot = malloc(chip8SnapshotSize());
+  if (ra->Ahead == NULL || ra->Snapshot == NULL) {
+    runAheadDestroy(ra);
+    return NULL;
+  }
+  return ra;
+}
+
+/**
+ * Free a run-ahead, the live machine is left alone.
+ */
+void runAheadDestroy(Chip8RunAhead *ra) {
+  if (ra->Ahead != NULL) {
+    chip8Destroy(ra->Ahead);
+  }
+  free(ra->Snapshot);
+  free(ra);
+}
+
+/**
+ * Run Frames frames ahead of the live machine, call once at the end of each
+ * frame.
+ *
+ * Returns:
+ *  Chip8*: The machine to draw, Frames frames in the future (or where it
+ *          halted).
+ */
+Chip8 *runAheadFrame(Chip8RunAhead *ra) {
+  double start = now();
+
+  chip8Snapshot(ra->Sys, ra->Snapshot);
+  chip8Restore(ra->Ahead, ra->Snapshot);
+  for (int frame = 0; frame < ra->Frames && !chip8Halted(ra->Ahead);
+       frame++) {
+    chip8RunFrame(ra->Ahead);
+  }
+
+  double elapsed = now() - start;
+  ra->Count++;
+  ra->Total += elapsed;
+  if (elapsed > ra->Worst) {
+    ra->Worst = elapsed;
+  }
+  return ra->Ahead;
+}
+
+/**
+ * Print the time run-ahead has taken per frame.
+ *
+ * Parameters:
+ *  const Chip8RunAhead* ra: The run-ahead.
+ *  FILE* out: Where to print.
+ */
+void runAheadReport(const Chip8RunAhead *ra, FILE *out) {
+  double average = ra->Count ? ra->Total / ra->Count : 0;
+
+  fprintf(out,
+          "Run-ahead %i frames: %llu frames, %.1fus average, %.1fus worst "
+          "(%.3f%% of the frame budget)\n",
+          ra->Frames, (unsigned long long)ra->Count, average * 1e6,
+          ra->Worst * 1e6, 100 * average / RUNAHEAD_FRAME_BUDGET);
+}
@@ -0,0 +1,54 @@
+/**
+ * Run-ahead: show the frame a few frames in the future to hide the frame or
+ * two many roms take to react to a key.
+ *
+ * Every frame the live machine is snapshotted and restored into a scratch
+ * machine, which runs Frames frames ahead with the keys as they are now.
+ * That future frame is drawn instead of the live one. The live machine is
+ * never run ahead itself, so nothing has to be put back afterwards and the
+ * trace and debugger only see the real instructions.
+ *
+ * Restoring only rewrites the memory pages that changed (see memory.h), so
+ * the cost per frame is mostly the extra Frames * CHIP8_CYCLES_PER_FRAME
+ * cycles. The time taken is measured every frame, see runAheadReport.
+ */
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+// The time there is to draw each frame at 60hz, in seconds.
+#define RUNAHEAD_FRAME_BUDGET (1.0 / 60)
+
+typedef struct Chip8RunAhead {
+  Chip8 *Sys;
+
+  /**
+   * Ahead: the scratch machine that runs ahead, the one to draw.
+   */
+  Chip8 *Ahead;
+  void *Snapshot;
+
+  /**
+   * Frames: how many frames ahead of Sys to run.
+   */
+  int Frames;
+
+  /**
+   * Overhead: the number of frames run ahead so far, and the total and
+   * worst time taken by one of them in seconds.
+   */
+  uint64_t Count;
+  double Total;
+  double Worst;
+} Chip8RunAhead;
+
+Chip8RunAhead *runAheadCreate(Chip8 *sys, int frames);
+void runAheadDestroy(Chip8RunAhead *ra);
+Chip8 *runAheadFrame(Chip8RunAhead *ra);
+void runAheadReport(const Chip8RunAhead *ra, FILE *out);
+
+#endif
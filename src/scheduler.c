@@ -0,0 +1,108 @@
+/**
+ * Scheduler, see scheduler.h.
+ */
+#include "scheduler.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The time the machine has emulated since the clocks were lined up, in
+ * seconds.
+ */
+static double emulatedSince(const Chip8Scheduler *sched) {
+  const Chip8 *sys = sched->Sys;
+  double frames = (double)(sys->Cycles - sched->StartCycles) /
+                  sys->Profile->CyclesPerFrame;
+  return frames / 60;
+}
+
+/**
+ * Create a scheduler for a machine, starting the clocks now.
+ *
+ * Parameters:
+ *  Chip8* sys: The machine.
+ *  int throttle: 1 to hold the machine to real time, 0 to only measure.
+ * Returns:
+ *  Chip8Scheduler*: The scheduler or NULL if it couldn't be allocated.
+ */
+Chip8Scheduler *schedulerCreate(Chip8 *sys, int throttle) {
+  Chip8Scheduler *sched = calloc(1, sizeof(Chip8Scheduler));
+  if (sched == NULL) {
+    return NULL;
+  }
+
+  sched->Sys = sys;
+  sched->Throttle = throttle;
+  sched->Start = now();
+  sched->StartCycles = sys->Cycles;
+  return sched;
+}
+
+/**
+ * Free a scheduler, the machine is left alone.
+ */
+void schedulerDestroy(Chip8Scheduler *sched) { free(sched); }
+
+/**
+ * Call at the end of each frame: waits until the host has caught up with
+ * the machine if throttling.
+ */
+void schedulerFrame(Chip8Scheduler *sched) {
+  double emulated = emulatedSince(sched);
+  double host = now() - sched->Start;
+
+  sched->Waited = 0;
+  if (sched->Throttle && emulated > host) {
+    double wait = emulated - host;
+    struct timespec ts = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+    nanosleep(&ts, NULL);
+    sched->Waited = now() - sched->Start - host;
+    host += sched->Waited;
+  }
+
+  if (host - emulated > 1.0 / 60) {
+    sched->Dropped++;
+  }
+
+  // Too far behind to catch up, line the clocks up again from here.
+  if (host - emulated > SCHEDULER_MAX_LAG) {
+    sched->Emulated += emulated;
+    sched->Host += host;
+    sched->Start += host;
+    sched->StartCycles = sched->Sys->Cycles;
+  }
+}
+
+/**
+ * How fast the machine has run compared to the one it emulates, e.g. 2.0 for
+ * twice as fast.
+ */
+double schedulerRatio(const Chip8Scheduler *sched) {
+  double emulated = sched->Emulated + emulatedSince(sched);
+  double host = sched->Host + (now() - sched->Start);
+  return host > 0 ? emulated / host : 0;
+}
+
+/**
+ * Print the time emulated and how fast it ran.
+ *
+ * Parameters:
+ *  const Chip8Scheduler* sched: The scheduler.
+ *  FILE* out: Where to print.
+ */
+void schedulerReport(const Chip8Scheduler *sched, FILE *out) {
+  double emulated = sched->Emulated + emulatedSince(sched);
+
+  fprintf(out,
+          "Emulated %.2fs at %.2fx real time (%llu cycles, %llu frames late)\n",
+          emulated, schedulerRatio(sched),
+          (unsigned long long)sched->Sys->Cycles,
+          (unsigned long long)sched->Dropped);
+}
@@ -0,0 +1,58 @@
+/**
+ * Scheduler: keeps a machine running at the speed of the one it emulates.
+ *
+ * The machine is run a frame at a time by cycles (see Chip8Profile), so a
+ * frame full of slow instructions (DXYN, FX55...) runs fewer of them, as on
+ * real hardware. After each frame the scheduler sleeps until the host clock
+ * catches up with the machines clock. If the host falls behind (e.g. while
+ * stopped in the debugger) it starts counting again from now rather than
+ * racing to catch up.
+ *
+ * Unthrottled, it only measures: either way schedulerReport prints how fast
+ * the machine ran compared to the real thing and how many frames were late.
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+// How far behind the host can fall before the scheduler gives up on
+// catching up, in seconds.
+#define SCHEDULER_MAX_LAG 0.25
+
+typedef struct Chip8Scheduler {
+  Chip8 *Sys;
+  int Throttle;
+
+  /**
+   * Where the clocks were last lined up: the host time in seconds and the
+   * machines cycle count.
+   */
+  double Start;
+  uint64_t StartCycles;
+
+  /**
+   * Totals: the time the machine has emulated and the host time taken to do
+   * it, in seconds.
+   */
+  double Emulated;
+  double Host;
+
+  /**
+   * Frames: the time spent waiting at the end of the last frame in seconds,
+   * and the number of frames that ended more than a frame late.
+   */
+  double Waited;
+  uint64_t Dropped;
+} Chip8Scheduler;
+
+Chip8Scheduler *schedulerCreate(Chip8 *sys, int throttle);
+void schedulerDestroy(Chip8Scheduler *sched);
+void schedulerFrame(Chip8Scheduler *sched);
+double schedulerRatio(const Chip8Scheduler *sched);
+void schedulerReport(const Chip8Scheduler *sched, FILE *out);
+
+#endif
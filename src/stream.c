@@ -0,0 +1,339 @@
+/**
+ * Framebuffer streaming, see stream.h for the format.
+ */
+#include "stream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Run length encode a row when it takes at most this many runs, beyond that
+// the 8 raw bytes are no longer.
+#define STREAM_MAX_RUNS 6
+
+/**
+ * Create a stream with no clients.
+ *
+ * Returns:
+ *  Chip8Stream*: The stream or NULL if it couldn't be allocated.
+ */
+Chip8Stream *streamCreate(void) {
+  Chip8Stream *stream = calloc(1, sizeof(Chip8Stream));
+  if (stream == NULL) {
+    return NULL;
+  }
+
+  stream->Listener = -1;
+  return stream;
+}
+
+/**
+ * Take a new client, queuing the header. It is sent a key frame next frame.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if it couldn't be allocated.
+ */
+static int addClient(Chip8Stream *stream, int fd) {
+  if (stream->ClientCount == stream->ClientCapacity) {
+    int capacity = stream->ClientCapacity ? stream->ClientCapacity * 2 : 4;
+    StreamClient **clients =
+        realloc(stream->Clients, capacity * sizeof(StreamClient *));
+    if (clients == NULL) {
+      return -1;
+    }
+    stream->Clients = clients;
+    stream->ClientCapacity = capacity;
+  }
+
+  StreamClient *client = malloc(sizeof(StreamClient));
+  if (client == NULL) {
+    return -1;
+  }
+
+  struct stat info;
+  client->Fd = fd;
+  client->Socket = fstat(fd, &info) == 0 && S_ISSOCK(info.st_mode);
+  client->NeedsKey = 1;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  uint8_t header[8] = {STREAM_MAGIC[0],     STREAM_MAGIC[1],
+                       STREAM_MAGIC[2],     STREAM_MAGIC[3],
+                       STREAM_VERSION,      CHIP8_DISPLAY_WIDTH,
+                       CHIP8_DISPLAY_HEIGHT, 0};
+  memcpy(client->Buffer, header, sizeof(header));
+  client->Used = sizeof(header);
+
+  stream->Clients[stream->ClientCount++] = client;
+  return 0;
+}
+
+/**
+ * Drop a client that has gone away, the last client takes its place.
+ */
+static void removeClient(Chip8Stream *stream, int index) {
+  close(stream->Clients[index]->Fd);
+  free(stream->Clients[index]);
+  stream->Clients[index] = stream->Clients[--stream->ClientCount];
+}
+
+/**
+ * Stream to a pipe or connected socket, e.g. one end of a socketpair. A
+ * pipe's reader going away raises SIGPIPE, so hosts streaming to pipes should
+ * ignore it.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the client couldn't be allocated.
+ */
+int streamAttach(Chip8Stream *stream, int fd) { return addClient(stream, fd); }
+
+/**
+ * Take clients connecting to a unix socket, checked once a frame.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the socket couldn't be opened.
+ */
+int streamListen(Chip8Stream *stream, const char *socketPath) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  strcpy(address.sun_path, socketPath);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    return -1;
+  }
+  unlink(socketPath);
+  if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(listener, 16) != 0) {
+    close(listener);
+    return -1;
+  }
+  fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+
+  stream->Listener = listener;
+  stream->SocketPath = strdup(socketPath);
+  return 0;
+}
+
+/**
+ * Close every client and the socket, and free the stream.
+ */
+void streamDestroy(Chip8Stream *stream) {
+  while (stream->ClientCount > 0) {
+    removeClient(stream, 0);
+  }
+  if (stream->Listener >= 0) {
+    close(stream->Listener);
+    unlink(stream->SocketPath);
+  }
+  free(stream->SocketPath);
+  free(stream->Clients);
+  free(stream);
+}
+
+/**
+ * Write as much of a client's buffer as it will take without waiting.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the client has gone away.
+ */
+static int flushClient(StreamClient *client) {
+  while (client->Used > 0) {
+    ssize_t sent;
+    if (client->Socket) {
+      sent = send(client->Fd, client->Buffer, client->Used,
+                  MSG_DONTWAIT | MSG_NOSIGNAL);
+    } else {
+      sent = write(client->Fd, client->Buffer, client->Used);
+    }
+
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    client->Used -= sent;
+    memmove(client->Buffer, client->Buffer + sent, client->Used);
+  }
+  return 0;
+}
+
+// Multiplying eight pixels read as a little endian word by this moves the
+// low bit of byte i to bit 56 + i.
+#define STREAM_GATHER 0x0102040810204080ull
+
+/**
+ * Pack a display to a bit per pixel, bit x of row y being pixel (x, y).
+ */
+static void packRows(const uint8_t *display, uint64_t *rows) {
+  for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+    const uint8_t *row = display + y * CHIP8_DISPLAY_WIDTH;
+    uint64_t bits = 0;
+    for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x += 8) {
+      uint64_t pixels;
+      memcpy(&pixels, row + x, sizeof(pixels));
+      pixels &= 0x0101010101010101ull;
+      bits |= ((pixels * STREAM_GATHER) >> 56) << x;
+    }
+    rows[y] = bits;
+  }
+}
+
+/**
+ * Encode the changed pixels of row y, run length encoded if that is shorter.
+ *
+ * Returns:
+ *  uint8_t*: Where the next row goes.
+ */
+static uint8_t *encodeRow(uint8_t *out, int y, uint64_t changed) {
+  uint8_t runs[STREAM_MAX_RUNS];
+  int count = 0;
+  int x = 0;
+
+  // Alternate runs of unchanged and changed pixels until none are left.
+  while (x < CHIP8_DISPLAY_WIDTH && (changed >> x) != 0) {
+    uint64_t rest = changed >> x;
+    if (count == STREAM_MAX_RUNS) {
+      count++;
+      break;
+    }
+    // Odd runs are changed pixels, count the ones instead of the zeros. A
+    // run to the end of the row has nothing left to count up to.
+    uint64_t bits = count % 2 == 0 ? rest : ~rest;
+    runs[count] = bits != 0 ? __builtin_ctzll(bits) : CHIP8_DISPLAY_WIDTH - x;
+    x += runs[count++];
+  }
+
+  if (count <= STREAM_MAX_RUNS) {
+    *out++ = y | STREAM_RLE;
+    *out++ = count;
+    memcpy(out, runs, count);
+    return out + count;
+  }
+
+  *out++ = y;
+  for (int i = 0; i < 8; i++) {
+    *out++ = changed >> (i * 8);
+  }
+  return out;
+}
+
+/**
+ * Encode a frame of the rows that differ between from and to, or a key frame
+ * of to if from is NULL.
+ *
+ * Returns:
+ *  size_t: The size of the frame, out[1] is the number of rows in it.
+ */
+static size_t encodeFrame(uint8_t *out, const uint64_t *from,
+                          const uint64_t *to) {
+  uint8_t *next = out + 2;
+  int count = 0;
+
+  for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y++) {
+    uint64_t changed = from != NULL ? from[y] ^ to[y] : to[y];
+    if (changed != 0) {
+      next = encodeRow(next, y, changed);
+      count++;
+    }
+  }
+  out[0] = from != NULL ? STREAM_DELTA : STREAM_KEY;
+  out[1] = count;
+  return next - out;
+}
+
+/**
+ * Send what changed on the display since the last frame to every client,
+ * never waiting for one. Call once a frame.
+ *
+ * Parameters:
+ *  Chip8Stream* stream: The stream.
+ *  const uint8_t* display: The display, e.g. from chip8GetFramebuffer.
+ */
+void streamFrame(Chip8Stream *stream, const uint8_t *display) {
+  stream->Frames++;
+  if (stream->Listener >= 0) {
+    int fd;
+    while ((fd = accept(stream->Listener, NULL, NULL)) >= 0) {
+      if (addClient(stream, fd) != 0) {
+        close(fd);
+      }
+    }
+  }
+  // With no one watching there is nothing to keep up to date, every new
+  // client starts with a key frame.
+  if (stream->ClientCount == 0) {
+    return;
+  }
+
+  uint64_t rows[CHIP8_DISPLAY_HEIGHT];
+  packRows(display, rows);
+  uint8_t delta[STREAM_MAX_FRAME];
+  size_t deltaSize = encodeFrame(delta, stream->Rows, rows);
+  int changed = delta[1] != 0;
+  stream->Changed += changed;
+
+  uint8_t key[STREAM_MAX_FRAME];
+  size_t keySize = 0;
+  for (int i = 0; i < stream->ClientCount; i++) {
+    StreamClient *client = stream->Clients[i];
+    const uint8_t *frame = NULL;
+    size_t size = 0;
+
+    if (client->NeedsKey) {
+      if (keySize == 0) {
+        keySize = encodeFrame(key, NULL, rows);
+      }
+      frame = key;
+      size = keySize;
+    } else if (changed) {
+      frame = delta;
+      size = deltaSize;
+    }
+
+    // Skip the frame rather than wait, the client catches up with a key.
+    if (frame != NULL) {
+      if (client->Used + size <= STREAM_BUFFER) {
+        memcpy(client->Buffer + client->Used, frame, size);
+        client->Used += size;
+        client->NeedsKey = 0;
+        stream->Bytes += size;
+      } else {
+        client->NeedsKey = 1;
+        stream->Skipped++;
+      }
+    }
+
+    if (client->Used > 0 && flushClient(client) != 0) {
+      removeClient(stream, i--);
+    }
+  }
+  memcpy(stream->Rows, rows, sizeof(rows));
+}
+
+/**
+ * Print how much the stream has sent.
+ *
+ * Parameters:
+ *  const Chip8Stream* stream: The stream.
+ *  FILE* out: Where to print.
+ */
+void streamReport(const Chip8Stream *stream, FILE *out) {
+  fprintf(out,
+          "Stream: %llu frames, %llu changed, %llu bytes (%.1f a frame), "
+          "%llu skipped for slow clients\n",
+          (unsigned long long)stream->Frames,
+          (unsigned long long)stream->Changed,
+          (unsigned long long)stream->Bytes,
+          stream->Frames ? (double)stream->Bytes / stream->Frames : 0,
+          (unsigned long long)stream->Skipped);
+}
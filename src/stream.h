@@ -0,0 +1,91 @@
+/**
+ * Framebuffer streaming: mirror a machine's display to spectators over a
+ * unix socket or pipe, sending only the rows that changed each frame.
+ *
+ * Each frame the display is packed to a bit per pixel and XORed with the
+ * last frame. Rows that changed are sent as their XOR, run length encoded
+ * when that is shorter, so a frame where nothing changed sends nothing at
+ * all. A client that has just connected, or fell behind, is sent a key frame
+ * (the XOR against a blank display) before any more deltas.
+ *
+ * Nothing ever waits on a client: writes are non-blocking into a buffer of
+ * STREAM_BUFFER bytes per client, and a frame that doesn't fit is skipped for
+ * that client, which gets a key frame once there is room again. A stream with
+ * no clients only checks for new ones (one accept a frame), so thousands of
+ * idle streams cost next to nothing.
+ *
+ * Format (all values little endian):
+ *  Header: "C8FB", uint8 version, uint8 width, uint8 height, uint8 reserved.
+ *  Frames: uint8 type (STREAM_DELTA or STREAM_KEY), uint8 row count, then
+ *   for each row a uint8 tag, the row number with STREAM_RLE if encoded:
+ *   - STREAM_RLE: uint8 count, then count run lengths alternating between
+ *     unchanged and changed pixels starting from x = 0 with unchanged (so the
+ *     first may be 0), the rest of the row is unchanged.
+ *   - Otherwise 8 bytes, bit x (LSB first) set if pixel x changed.
+ *  A key frame starts from a blank display, a delta from the last frame.
+ *  The reference viewer is tools/chip8view.c.
+ */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8.h"
+
+#define STREAM_MAGIC "C8FB"
+#define STREAM_VERSION 1
+
+// Frame types.
+#define STREAM_DELTA 0
+#define STREAM_KEY 1
+
+// Row tag flag, the rest is the row number.
+#define STREAM_RLE 0x80
+
+// The largest frame: every row sent raw.
+#define STREAM_MAX_FRAME (2 + CHIP8_DISPLAY_HEIGHT * 9)
+
+// The bytes buffered per client before frames are skipped for it.
+#define STREAM_BUFFER 4096
+
+typedef struct StreamClient {
+  int Fd;
+  int Socket; // Whether Fd is a socket (sent without SIGPIPE) or a pipe.
+  int NeedsKey;
+  size_t Used;
+  uint8_t Buffer[STREAM_BUFFER];
+} StreamClient;
+
+typedef struct Chip8Stream {
+  /**
+   * Rows: the last frame sent, a bit per pixel.
+   */
+  uint64_t Rows[CHIP8_DISPLAY_HEIGHT];
+
+  int Listener;
+  char *SocketPath;
+
+  StreamClient **Clients;
+  int ClientCount;
+  int ClientCapacity;
+
+  /**
+   * Totals: frames seen, frames with changes, bytes queued and frames
+   * skipped for clients that were behind.
+   */
+  uint64_t Frames;
+  uint64_t Changed;
+  uint64_t Bytes;
+  uint64_t Skipped;
+} Chip8Stream;
+
+Chip8Stream *streamCreate(void);
+int streamListen(Chip8Stream *stream, const char *socketPath);
+int streamAttach(Chip8Stream *stream, int fd);
+void streamDestroy(Chip8Stream *stream);
+void streamFrame(Chip8Stream *stream, const uint8_t *display);
+void streamReport(const Chip8Stream *stream, FILE *out);
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * Binary execution trace, see trace.h for the format.
+ */
+#include "trace.h"
+#include "memory.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The ring is TRACE_CHUNKS chunks of TRACE_CHUNK_SIZE bytes.
+#define TRACE_CHUNK_SIZE (64 * 1024)
+#define TRACE_CHUNKS 8
+// Larger than the largest record (FX65 changing V0->VF and I).
+#define TRACE_MAX_RECORD 128
+
+struct Chip8Trace {
+  FILE *fp;
+  pthread_t writer;
+  pthread_mutex_t lock;
+  pthread_cond_t filled; // A chunk is ready to write, or closing.
+  pthread_cond_t freed;  // A chunk has been written.
+
+  uint8_t *chunks[TRACE_CHUNKS];
+  size_t used[TRACE_CHUNKS];
+  int head;    // The chunk being filled by the interpreter.
+  int tail;    // The next chunk for the writer.
+  int pending; // Filled chunks not yet written.
+  int closing;
+  int failed; // A write came up short, set by the writer.
+
+  // Write position in the head chunk.
+  uint8_t *out;
+  uint8_t *end;
+
+  // The state before the current instruction.
+  uint16_t PC;
+  uint16_t opcode;
+  uint16_t lastPC;
+  uint8_t V[16];
+  uint16_t I;
+  uint8_t StackPointer;
+  uint64_t DelayExpiry;
+  uint64_t SoundExpiry;
+};
+
+/**
+ * The writer thread, writes filled chunks in order until closed.
+ */
+static void *writeChunks(void *arg) {
+  Chip8Trace *trace = arg;
+
+  pthread_mutex_lock(&trace->lock);
+  while (1) {
+    while (trace->pending == 0 && !trace->closing) {
+      pthread_cond_wait(&trace->filled, &trace->lock);
+    }
+    if (trace->pending == 0) {
+      break;
+    }
+    int chunk = trace->tail;
+    pthread_mutex_unlock(&trace->lock);
+
+    // After a failed write the rest is dropped, a trace with a gap in it
+    // would decode as the wrong instructions.
+    if (!trace->failed &&
+        fwrite(trace->chunks[chunk], 1, trace->used[chunk], trace->fp) !=
+            trace->used[chunk]) {
+      trace->failed = 1;
+    }
+
+    pthread_mutex_lock(&trace->lock);
+    trace->tail = (trace->tail + 1) % TRACE_CHUNKS;
+    trace->pending--;
+    pthread_cond_signal(&trace->freed);
+  }
+  pthread_mutex_unlock(&trace->lock);
+  return NULL;
+}
+
+/**
+ * Hand the head chunk to the writer and move on to the next one, waiting if
+ * every chunk is still waiting to be written.
+ */
+static void submitChunk(Chip8Trace *trace) {
+  pthread_mutex_lock(&trace->lock);
+  trace->used[trace->head] = trace->out - trace->chunks[trace->head];
+  trace->pending++;
+  pthread_cond_signal(&trace->filled);
+
+  trace->head = (trace->head + 1) % TRACE_CHUNKS;
+  while (trace->pending == TRACE_CHUNKS) {
+    pthread_cond_wait(&trace->freed, &trace->lock);
+  }
+  pthread_mutex_unlock(&trace->lock);
+
+  trace->out = trace->chunks[trace->head];
+  trace->end = trace->out + TRACE_CHUNK_SIZE;
+}
+
+/**
+ * Free a trace and its chunks and close its file.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if closing the file failed.
+ */
+static int freeTrace(Chip8Trace *trace) {
+  int result = fclose(trace->fp) == 0 ? 0 : -1;
+  for (int i = 0; i < TRACE_CHUNKS; i++) {
+    free(trace->chunks[i]);
+  }
+  free(trace);
+  return result;
+}
+
+/**
+ * Open a trace file and start its writer thread.
+ *
+ * Parameters:
+ *  const char* filePath: Where to write the trace.
+ * Returns:
+ *  Chip8Trace*: The trace or NULL if it couldn't be opened.
+ */
+Chip8Trace *traceOpen(const char *filePath) {
+  Chip8Trace *trace = calloc(1, sizeof(Chip8Trace));
+  if (trace == NULL) {
+    return NULL;
+  }
+
+  trace->fp = fopen(filePath, "wb");
+  if (trace->fp == NULL) {
+    free(trace);
+    return NULL;
+  }
+
+  uint8_t header[8] = {TRACE_MAGIC[0], TRACE_MAGIC[1], TRACE_MAGIC[2],
+                       TRACE_MAGIC[3], TRACE_VERSION,  0,
+                       0,              0};
+  if (fwrite(header, 1, sizeof(header), trace->fp) != sizeof(header)) {
+    freeTrace(trace);
+    return NULL;
+  }
+
+  for (int i = 0; i < TRACE_CHUNKS; i++) {
+    trace->chunks[i] = malloc(TRACE_CHUNK_SIZE);
+    if (trace->chunks[i] == NULL) {
+      freeTrace(trace);
+      return NULL;
+    }
+  }
+  trace->out = trace->chunks[0];
+  trace->end = trace->out + TRACE_CHUNK_SIZE;
+  // Never matches so the first record has its PC.
+  trace->lastPC = 0xFFFF;
+
+  pthread_mutex_init(&trace->lock, NULL);
+  pthread_cond_init(&trace->filled, NULL);
+  pthread_cond_init(&trace->freed, NULL);
+  if (pthread_create(&trace->writer, NULL, writeChunks, trace) != 0) {
+    pthread_mutex_destroy(&trace->lock);
+    pthread_cond_destroy(&trace->filled);
+    pthread_cond_destroy(&trace->freed);
+    freeTrace(trace);
+    return NULL;
+  }
+  return trace;
+}
+
+/**
+ * Write out everything recorded so far, stop the writer and close the file.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if some of the trace couldn't be written (the file
+ *  then holds only the records before the failed write).
+ */
+int traceClose(Chip8Trace *trace) {
+  if (trace->out != trace->chunks[trace->head]) {
+    submitChunk(trace);
+  }
+
+  pthread_mutex_lock(&trace->lock);
+  trace->closing = 1;
+  pthread_cond_signal(&trace->filled);
+  pthread_mutex_unlock(&trace->lock);
+  pthread_join(trace->writer, NULL);
+
+  int failed = trace->failed;
+  pthread_mutex_destroy(&trace->lock);
+  pthread_cond_destroy(&trace->filled);
+  pthread_cond_destroy(&trace->freed);
+  if (freeTrace(trace) != 0 || failed) {
+    return -1;
+  }
+  return 0;
+}
+
+static inline uint8_t *put16(uint8_t *out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+/**
+ * Remember the state before an instruction runs.
+ */
+void traceBefore(Chip8Trace *trace, const Chip8 *sys) {
+  trace->PC = sys->PC;
+  trace->opcode = memoryFetch(sys, sys->PC & 0xFFF);
+  memcpy(trace->V, sys->V, sizeof(trace->V));
+  trace->I = sys->I;
+  trace->StackPointer = sys->StackPointer;
+  trace->DelayExpiry = sys->DelayExpiry;
+  trace->SoundExpiry = sys->SoundExpiry;
+}
+
+/**
+ * Record an instruction, comparing the state to that saved by traceBefore.
+ */
+void traceAfter(Chip8Trace *trace, const Chip8 *sys) {
+  if (trace->end - trace->out < TRACE_MAX_RECORD) {
+    submitChunk(trace);
+  }
+
+  uint8_t *flags = trace->out;
+  uint8_t *out = flags + 1;
+  int count = 0;
+
+  *flags = 0;
+  if (trace->PC == (uint16_t)(trace->lastPC + 2)) {
+    *flags |= TRACE_NEXT_PC;
+  } else {
+    out = put16(out, trace->PC);
+  }
+  out = put16(out, trace->opcode);
+  trace->lastPC = trace->PC;
+
+  // Most instructions change at most one register, check them all at once.
+  if (memcmp(sys->V, trace->V, sizeof(trace->V)) != 0) {
+    for (int x = 0; x < 16; x++) {
+      if (sys->V[x] != trace->V[x]) {
+        *out++ = TRACE_TAG_V + x;
+        *out++ = sys->V[x];
+        count++;
+      }
+    }
+  }
+  if (sys->I != trace->I) {
+    *out++ = TRACE_TAG_I;
+    out = put16(out, sys->I);
+    count++;
+  }
+  if (sys->StackPointer != trace->StackPointer) {
+    *out++ = TRACE_TAG_SP;
+    *out++ = sys->StackPointer;
+    count++;
+  }
+  // Timers only change when set, counting down is implied by the cycles.
+  if (sys->DelayExpiry != trace->DelayExpiry) {
+    *out++ = TRACE_TAG_DELAY;
+    *out++ = readTimer(sys, sys->DelayExpiry);
+    count++;
+  }
+  if (sys->SoundExpiry != trace->SoundExpiry) {
+    *out++ = TRACE_TAG_SOUND;
+    *out++ = readTimer(sys, sys->SoundExpiry);
+    count++;
+  }
+
+  // Only FX33 and FX55 write to memory, both starting at the old I.
+  int written = 0;
+  if ((trace->opcode & 0xF0FF) == 0xF033) {
+    written = 3;
+  } else if ((trace->opcode & 0xF0FF) == 0xF055) {
+    written = ((trace->opcode & 0x0F00) >> 8) + 1;
+  }
+  if (written && !sys->Fault) {
+    *out++ = TRACE_TAG_MEMORY;
+    out = put16(out, trace->I & 0xFFF);
+    *out++ = written;
+    for (int i = 0; i < written; i++) {
+      *out++ = memoryRead(sys, (trace->I + i) & 0xFFF);
+    }
+    count++;
+  }
+
+  if (sys->Fault) {
+    *out++ = TRACE_TAG_FAULT;
+    *out++ = sys->Fault;
+    count++;
+  }
+
+  *flags |= count;
+  trace->out = out;
+}
+
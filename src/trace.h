@@ -0,0 +1,61 @@
+/**
+ * Binary execution trace.
+ *
+ * While a trace is attached to a system every instruction appends a record
+ * to an in-memory ring of chunks. Full chunks are written to the file by a
+ * background thread so the interpreter never waits on the disk (unless the
+ * disk falls a whole ring behind).
+ *
+ * File format (all values little endian):
+ *  Header: "C8TR", uint16 version, uint16 reserved.
+ *  Records: uint8 flags, then
+ *   - unless TRACE_TICK: uint16 PC (omitted if TRACE_NEXT_PC, meaning the
+ *     previous records PC + 2) and uint16 opcode.
+ *   - (flags & TRACE_COUNT_MASK) change entries, each a uint8 tag then:
+ *     TRACE_TAG_V + x: uint8 new VX.
+ *     TRACE_TAG_I: uint16 new I.
+ *     TRACE_TAG_SP: uint8 new stack pointer.
+ *     TRACE_TAG_DELAY / TRACE_TAG_SOUND: uint8 new timer value.
+ *     TRACE_TAG_MEMORY: uint16 address, uint8 length, then the bytes written
+ *                       (the address wraps at 0xFFF).
+ *     TRACE_TAG_FAULT: uint8 fault, the system halted.
+ *  Timers count down once a frame without an entry (every
+ *  CHIP8_CYCLES_PER_FRAME records with the uniform profile), DELAY and SOUND
+ *  entries only appear when a timer is set. In version 1 traces each count
+ *  down was a TRACE_TICK record with no PC or opcode instead.
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include "cpu.h"
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 2
+
+// Record flags.
+#define TRACE_COUNT_MASK 0x1F
+#define TRACE_NEXT_PC 0x20
+#define TRACE_TICK 0x80 // Version 1 only.
+
+// Change entry tags.
+#define TRACE_TAG_V 0x00
+#define TRACE_TAG_I 0x10
+#define TRACE_TAG_SP 0x11
+#define TRACE_TAG_DELAY 0x12
+#define TRACE_TAG_SOUND 0x13
+#define TRACE_TAG_MEMORY 0x20
+#define TRACE_TAG_FAULT 0x30
+
+// The longest TRACE_TAG_MEMORY entry, FX55 with X = F.
+#define TRACE_MAX_WRITE 16
+
+typedef struct Chip8Trace Chip8Trace;
+
+Chip8Trace *traceOpen(const char *filePath);
+int traceClose(Chip8Trace *trace);
+void traceBefore(Chip8Trace *trace, const Chip8 *sys);
+void traceAfter(Chip8Trace *trace, const Chip8 *sys);
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * Static disassembler for roms.
+ *
+ * Usage:
+ *  chip8dis path/to/game.ch8          Annotated listing.
+ *  chip8dis --dot path/to/game.ch8    Control flow graph in graphviz DOT.
+ */
+#include "../src/analysis.h"
+#include "../src/disasm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// The number of data bytes per listing line.
+#define DATA_PER_LINE 8
+
+static uint8_t memory[4096];
+static RomAnalysis analysis;
+
+static uint16_t opcodeAt(uint16_t address) {
+  return (memory[address & 0xFFF] << 8) | memory[(address + 1) & 0xFFF];
+}
+
+/**
+ * Print the label for an address, if it needs one.
+ */
+static void printLabel(uint16_t address) {
+  uint16_t flags = analysis.Flags[address];
+
+  if (address == 0x200) {
+    printf("start:\n");
+  } else if (flags & ANALYSIS_CALL_TARGET) {
+    printf("sub_%03X:\n", address);
+  } else if (flags & ANALYSIS_LEADER && flags & ANALYSIS_CODE) {
+    printf("loc_%03X:\n", address);
+  } else if (flags & ANALYSIS_DATA_REF && !(flags & ANALYSIS_CODE)) {
+    printf("data_%03X:\n", address);
+  }
+}
+
+static void printInstruction(uint16_t address) {
+  uint16_t opcode = opcodeAt(address);
+  uint16_t flags = analysis.Flags[address];
+  char text[32];
+  char comment[128] = "";
+
+  disassemble(opcode, text, sizeof(text));
+
+  if ((opcode & 0xF000) == 0xA000) {
+    uint16_t target = opcode & 0x0FFF;
+    strcat(comment, analysis.Flags[target] & ANALYSIS_CODE ? " ; I -> code"
+                                                           : " ; I -> data");
+  }
+  if (flags & ANALYSIS_SELF_MODIFY) {
+    strcat(comment, " ; writes over code");
+  }
+  if (flags & ANALYSIS_UNKNOWN_WRITE) {
+    strcat(comment, " ; writes with I unknown");
+  }
+  if (flags & ANALYSIS_INDIRECT) {
+    strcat(comment, " ; computed jump");
+  }
+  if (flags & ANALYSIS_HALT) {
+    strcat(comment, " ; unknown opcode, halts");
+  }
+  if ((flags | analysis.Flags[(address + 1) & 0xFFF]) & ANALYSIS_WRITTEN) {
+    strcat(comment, " ; overwritten");
+  }
+
+  if (comment[0]) {
+    printf("  %03X  %04X  %-20s%s\n", address, opcode, text, comment);
+  } else {
+    printf("  %03X  %04X  %s\n", address, opcode, text);
+  }
+}
+
+static void listing(const char *romPath, long size) {
+  printf("; %s: %ld bytes, %i instructions in %i blocks\n", romPath, size,
+         analysis.Instructions, analysis.Blocks);
+  printf("; %i self-modifying write(s), %i write(s) with I unknown\n\n",
+         analysis.SelfModifying, analysis.UnknownWrites);
+
+  uint16_t end = 0x200 + size;
+  uint16_t address = 0x200;
+  while (address < end) {
+    printLabel(address);
+    if (analysis.Flags[address] & ANALYSIS_CODE) {
+      printInstruction(address);
+      address += 2;
+      continue;
+    }
+
+    // A run of data, up to the next code, label or line end.
+    printf("  %03X  DB   ", address);
+    int count = 0;
+    do {
+      printf("%s0x%02X", count ? ", " : "", memory[address]);
+      address++;
+      count++;
+    } while (address < end && count < DATA_PER_LINE &&
+             !(analysis.Flags[address] &
+               (ANALYSIS_CODE | ANALYSIS_DATA_REF | ANALYSIS_LEADER)));
+    printf("\n");
+  }
+}
+
+static void dot(void) {
+  char text[32];
+
+  printf("digraph cfg {\n");
+  printf("  node [shape=box fontname=monospace];\n");
+  for (int leader = 0; leader < 4096; leader++) {
+    uint16_t flags = analysis.Flags[leader];
+    if ((flags & (ANALYSIS_LEADER | ANALYSIS_CODE)) !=
+        (ANALYSIS_LEADER | ANALYSIS_CODE)) {
+      continue;
+    }
+
+    uint16_t end = blockEnd(memory, &analysis, leader);
+    printf("  b%03X [label=\"", leader);
+    for (uint16_t address = leader;; address = (address + 2) & 0xFFF) {
+      disassemble(opcodeAt(address), text, sizeof(text));
+      printf("%03X  %s\\l", address, text);
+      if (address == end) {
+        break;
+      }
+    }
+    printf("\"%s];\n", flags & ANALYSIS_CALL_TARGET ? " color=blue" : "");
+
+    uint16_t opcode = opcodeAt(end);
+    uint16_t targets[2];
+    int count = successors(end, opcode, targets);
+    for (int i = 0; i < count; i++) {
+      printf("  b%03X -> b%03X;\n", leader, targets[i]);
+    }
+    if ((opcode & 0xF000) == 0x2000) {
+      printf("  b%03X -> b%03X [style=dashed];\n", leader, opcode & 0x0FFF);
+    }
+  }
+  printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  int asDot = argc == 3 && strcmp(argv[1], "--dot") == 0;
+  if (argc != 2 && !asDot) {
+    printf("Usage: chip8dis [--dot] path/to/game.ch8\n");
+    return 2;
+  }
+
+  const char *romPath = argv[argc - 1];
+  FILE *fp = fopen(romPath, "rb");
+  if (fp == NULL) {
+    printf("Couldn't load rom.\n");
+    return 1;
+  }
+  long size = fread(memory + 0x200, 1, sizeof(memory) - 0x200, fp);
+  fclose(fp);
+
+  analyseRom(memory, 0x200, &analysis);
+  if (asDot) {
+    dot();
+  } else {
+    listing(romPath, size);
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * Records sessions without a display and verifies recordings (see
+ * src/record.h).
+ *
+ * Usage:
+ *  chip8replay verify session.rec [threads]
+ *      Replay every segment, on one thread per core by default.
+ *  chip8replay record game.ch8 session.rec frames [interval]
+ *      Run a rom for frames frames pressing keys at random (the same every
+ *      time), checkpointing every interval frames.
+ */
+#include "../src/record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Change the keys about once in this many frames.
+#define RECORD_KEY_CHANCE 8
+
+static int record(char *romPath, const char *filePath, long frames,
+                  uint32_t interval) {
+  Chip8 *sys = systemInit();
+  seedRandom(sys, 1);
+  loadRom(romPath, sys);
+  if (sys->FileNotFound) {
+    fprintf(stderr, "Couldn't load %s.\n", romPath);
+    return 1;
+  }
+
+  Chip8Recorder *rec = recordOpen(sys, filePath, interval);
+  if (rec == NULL) {
+    fprintf(stderr, "Couldn't open %s.\n", filePath);
+    return 1;
+  }
+
+  uint32_t period = sys->Profile->CyclesPerFrame;
+  uint32_t random = 0x9E3779B9;
+  for (long frame = 0; frame < frames && !sys->Quit; frame++) {
+    uint64_t end = (sys->Cycles / period + 1) * period;
+    while (sys->Cycles < end && !sys->Quit) {
+      cycleSystem(sys);
+    }
+
+    // Xorshift, as the machine's own CXNN.
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    if (random % RECORD_KEY_CHANCE == 0) {
+      chip8SetKeys(sys, random >> 16);
+      recordInput(rec, sys);
+    }
+    recordFrame(rec, sys);
+  }
+
+  recordClose(rec, sys);
+  systemFree(sys);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if ((argc == 3 || argc == 4) && strcmp(argv[1], "verify") == 0) {
+    int threads = argc == 4 ? atoi(argv[3]) : sysconf(_SC_NPROCESSORS_ONLN);
+    int failed = recordVerify(argv[2], threads, stdout);
+    if (failed < 0) {
+      fprintf(stderr,
+              "Couldn't read %s as a version %i recording (it must be a "
+              "file, starting with a checkpoint).\n",
+              argv[2], RECORD_VERSION);
+      return 2;
+    }
+    return failed > 0;
+  }
+  if ((argc == 5 || argc == 6) && strcmp(argv[1], "record") == 0) {
+    uint32_t interval = argc == 6 ? atoi(argv[5]) : RECORD_INTERVAL;
+    return record(argv[2], argv[3], atol(argv[4]), interval);
+  }
+  printf("Usage: chip8replay verify session.rec [threads]\n");
+  printf("       chip8replay record game.ch8 session.rec frames [interval]\n");
+  return 2;
+}
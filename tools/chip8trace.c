@@ -0,0 +1,233 @@
+/**
+ * Offline decoder for binary traces (see src/trace.h).
+ *
+ * Usage:
+ *  chip8trace dump trace.bin        Print every record as text.
+ *  chip8trace diff a.bin b.bin      Print the first record that differs.
+ *                                   Exits 0 if none do, 1 if one does and 2
+ *                                   if a trace can't be read in full.
+ */
+#include "../src/trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The number of matching records shown before a difference.
+#define DIFF_CONTEXT 4
+
+typedef struct TraceReader {
+  uint8_t *data;
+  size_t size;
+  size_t pos;
+  uint16_t lastPC;
+  long record;
+} TraceReader;
+
+/**
+ * Read a whole trace file and check its header.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the file can't be read or isn't a trace.
+ */
+static int openTrace(TraceReader *reader, const char *filePath) {
+  FILE *fp = fopen(filePath, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "Couldn't open %s.\n", filePath);
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  memset(reader, 0, sizeof(TraceReader));
+  reader->data = malloc(size > 0 ? size : 1);
+  reader->size = fread(reader->data, 1, size, fp);
+  fclose(fp);
+
+  // Version 1 only adds TRACE_TICK records, which are still decoded.
+  if (reader->size < 8 || memcmp(reader->data, TRACE_MAGIC, 4) != 0 ||
+      reader->data[4] < 1 || reader->data[4] > TRACE_VERSION) {
+    fprintf(stderr, "%s is not a version 1 to %i trace.\n", filePath,
+            TRACE_VERSION);
+    free(reader->data);
+    return -1;
+  }
+  reader->pos = 8;
+  reader->lastPC = 0xFFFF;
+  return 0;
+}
+
+/**
+ * Whether there are at least count bytes left to read.
+ */
+static int has(TraceReader *reader, size_t count) {
+  return reader->size - reader->pos >= count;
+}
+
+static uint16_t get16(TraceReader *reader) {
+  uint16_t value = reader->data[reader->pos] |
+                   (reader->data[reader->pos + 1] << 8);
+  reader->pos += 2;
+  return value;
+}
+
+/**
+ * Append to a line, dropping whatever doesn't fit.
+ */
+static void append(char *line, size_t size, size_t *used, const char *format,
+                   ...) {
+  if (*used >= size) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(line + *used, size - *used, format, args);
+  va_end(args);
+  if (written > 0) {
+    *used += written;
+  }
+}
+
+/**
+ * Decode the next record into line.
+ *
+ * Returns:
+ *  int: 1 if a record was decoded, 0 at the end of the trace and -1 if the
+ *       trace is truncated or corrupt.
+ */
+static int nextRecord(TraceReader *reader, char *line, size_t size) {
+  size_t used = 0;
+  if (!has(reader, 1)) {
+    return 0;
+  }
+
+  uint8_t flags = reader->data[reader->pos++];
+  append(line, size, &used, "#%-8ld ", reader->record++);
+
+  if (flags & TRACE_TICK) {
+    append(line, size, &used, "timers tick");
+    return 1;
+  }
+
+  if (!has(reader, (flags & TRACE_NEXT_PC) ? 2 : 4)) {
+    return -1;
+  }
+  uint16_t PC = (flags & TRACE_NEXT_PC) ? reader->lastPC + 2 : get16(reader);
+  uint16_t opcode = get16(reader);
+  reader->lastPC = PC;
+  append(line, size, &used, "%03X  %04X ", PC, opcode);
+
+  int count = flags & TRACE_COUNT_MASK;
+  for (int i = 0; i < count; i++) {
+    // Every entry is at least a tag and a byte.
+    if (!has(reader, 2)) {
+      return -1;
+    }
+    uint8_t tag = reader->data[reader->pos++];
+    if (tag < TRACE_TAG_V + 16) {
+      append(line, size, &used, " V%X=%02X", tag, reader->data[reader->pos++]);
+    } else if (tag == TRACE_TAG_I) {
+      if (!has(reader, 2)) {
+        return -1;
+      }
+      append(line, size, &used, " I=%03X", get16(reader));
+    } else if (tag == TRACE_TAG_SP) {
+      append(line, size, &used, " SP=%i", reader->data[reader->pos++]);
+    } else if (tag == TRACE_TAG_DELAY) {
+      append(line, size, &used, " DT=%i", reader->data[reader->pos++]);
+    } else if (tag == TRACE_TAG_SOUND) {
+      append(line, size, &used, " ST=%i", reader->data[reader->pos++]);
+    } else if (tag == TRACE_TAG_MEMORY) {
+      if (!has(reader, 3)) {
+        return -1;
+      }
+      uint16_t address = get16(reader);
+      int length = reader->data[reader->pos++];
+      // No instruction writes more, anything longer is corrupt.
+      if (length > TRACE_MAX_WRITE || !has(reader, length)) {
+        return -1;
+      }
+      append(line, size, &used, " [%03X]=", address);
+      for (int b = 0; b < length; b++) {
+        append(line, size, &used, "%02X", reader->data[reader->pos++]);
+      }
+    } else if (tag == TRACE_TAG_FAULT) {
+      append(line, size, &used, " FAULT=%i", reader->data[reader->pos++]);
+    } else {
+      append(line, size, &used, " <bad tag %#04X>", tag);
+      return -1;
+    }
+  }
+  return 1;
+}
+
+static int dump(const char *filePath) {
+  TraceReader reader;
+  char line[512];
+  int status;
+
+  if (openTrace(&reader, filePath) != 0) {
+    return 2;
+  }
+  while ((status = nextRecord(&reader, line, sizeof(line))) == 1) {
+    printf("%s\n", line);
+  }
+  if (status < 0) {
+    printf("<truncated>\n");
+  }
+  free(reader.data);
+  return status < 0;
+}
+
+static int diff(const char *pathA, const char *pathB) {
+  TraceReader a, b;
+  char lineA[512], lineB[512];
+  char context[DIFF_CONTEXT][512];
+  long matched = 0;
+
+  if (openTrace(&a, pathA) != 0 || openTrace(&b, pathB) != 0) {
+    return 2;
+  }
+
+  while (1) {
+    int statusA = nextRecord(&a, lineA, sizeof(lineA));
+    int statusB = nextRecord(&b, lineB, sizeof(lineB));
+
+    // A trace that is cut short or corrupt can't be compared past that point.
+    if (statusA < 0 || statusB < 0) {
+      fprintf(stderr, "%s is truncated or corrupt after %ld records.\n",
+              statusA < 0 ? pathA : pathB, matched);
+      return 2;
+    }
+    if (statusA == 0 && statusB == 0) {
+      printf("Traces match (%ld records).\n", matched);
+      return 0;
+    }
+    if (statusA != statusB || strcmp(lineA, lineB) != 0) {
+      long first = matched > DIFF_CONTEXT ? matched - DIFF_CONTEXT : 0;
+      for (long i = first; i < matched; i++) {
+        printf("  %s\n", context[i % DIFF_CONTEXT]);
+      }
+      printf("- %s\n", statusA == 1 ? lineA : "<end of trace>");
+      printf("+ %s\n", statusB == 1 ? lineB : "<end of trace>");
+      return 1;
+    }
+    strcpy(context[matched % DIFF_CONTEXT], lineA);
+    matched++;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc == 3 && strcmp(argv[1], "dump") == 0) {
+    return dump(argv[2]);
+  }
+  if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+    return diff(argv[2], argv[3]);
+  }
+  printf("Usage: chip8trace dump trace.bin\n");
+  printf("       chip8trace diff a.bin b.bin\n");
+  return 2;
+}
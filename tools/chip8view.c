@@ -0,0 +1,161 @@
+/**
+ * Reference viewer for framebuffer streams (see src/stream.h), drawing each
+ * frame on the terminal.
+ *
+ * Usage:
+ *  chip8view stream.sock      Connect to a machine run with --stream.
+ *  chip8view -                Read a stream from stdin, e.g. a pipe.
+ *  chip8view -q stream.sock   Decode without drawing, print totals at the
+ *                             end.
+ */
+#include "../src/stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Connect to a stream's unix socket.
+ *
+ * Returns:
+ *  FILE*: The stream to read or NULL if it couldn't connect.
+ */
+static FILE *connectTo(const char *socketPath) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(socketPath) >= sizeof(address.sun_path)) {
+    return NULL;
+  }
+  strcpy(address.sun_path, socketPath);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return NULL;
+  }
+  return fdopen(fd, "rb");
+}
+
+/**
+ * Apply one row of a frame to the display.
+ *
+ * Returns:
+ *  int: 0 on success, -1 if the stream ended or is malformed.
+ */
+static int readRow(FILE *in, uint64_t *rows) {
+  int tag = fgetc(in);
+  if (tag == EOF || (tag & ~STREAM_RLE) >= CHIP8_DISPLAY_HEIGHT) {
+    return -1;
+  }
+
+  uint64_t changed = 0;
+  if (tag & STREAM_RLE) {
+    int count = fgetc(in);
+    int x = 0;
+    for (int run = 0; run < count; run++) {
+      int length = fgetc(in);
+      if (length == EOF || x + length > CHIP8_DISPLAY_WIDTH) {
+        return -1;
+      }
+      // Odd runs are the changed pixels.
+      for (int i = 0; run % 2 == 1 && i < length; i++) {
+        changed |= 1ull << (x + i);
+      }
+      x += length;
+    }
+  } else {
+    uint8_t bytes[8];
+    if (fread(bytes, 1, sizeof(bytes), in) != sizeof(bytes)) {
+      return -1;
+    }
+    for (int i = 0; i < 8; i++) {
+      changed |= (uint64_t)bytes[i] << (i * 8);
+    }
+  }
+
+  rows[tag & ~STREAM_RLE] ^= changed;
+  return 0;
+}
+
+/**
+ * Draw the display two rows to a line with half blocks, over the last one.
+ */
+static void drawRows(const uint64_t *rows) {
+  printf("\033[H");
+  for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; y += 2) {
+    for (int x = 0; x < CHIP8_DISPLAY_WIDTH; x++) {
+      int top = (rows[y] >> x) & 1;
+      int bottom = (rows[y + 1] >> x) & 1;
+      fputs(top && bottom ? "█"
+            : top         ? "▀"
+            : bottom      ? "▄"
+                          : " ",
+            stdout);
+    }
+    putchar('\n');
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  int quiet = argc > 1 && !strcmp(argv[1], "-q");
+  const char *source = argc > 1 + quiet ? argv[1 + quiet] : NULL;
+  if (source == NULL) {
+    fprintf(stderr, "Usage: chip8view [-q] stream.sock|-\n");
+    return 1;
+  }
+
+  FILE *in = !strcmp(source, "-") ? stdin : connectTo(source);
+  if (in == NULL) {
+    fprintf(stderr, "Couldn't connect to %s.\n", source);
+    return 1;
+  }
+
+  uint8_t header[8];
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+      memcmp(header, STREAM_MAGIC, 4) != 0 || header[4] != STREAM_VERSION ||
+      header[5] != CHIP8_DISPLAY_WIDTH || header[6] != CHIP8_DISPLAY_HEIGHT) {
+    fprintf(stderr, "%s is not a version %i stream.\n", source,
+            STREAM_VERSION);
+    return 1;
+  }
+
+  if (!quiet) {
+    printf("\033[2J");
+  }
+  uint64_t rows[CHIP8_DISPLAY_HEIGHT] = {0};
+  long frames = 0;
+  long keys = 0;
+  int type;
+  while ((type = fgetc(in)) != EOF) {
+    int count = fgetc(in);
+    if (count == EOF || (type != STREAM_DELTA && type != STREAM_KEY)) {
+      fprintf(stderr, "Malformed frame %li.\n", frames);
+      return 1;
+    }
+    if (type == STREAM_KEY) {
+      memset(rows, 0, sizeof(rows));
+      keys++;
+    }
+    for (int row = 0; row < count; row++) {
+      if (readRow(in, rows) != 0) {
+        fprintf(stderr, "Malformed frame %li.\n", frames);
+        return 1;
+      }
+    }
+    frames++;
+    if (!quiet) {
+      drawRows(rows);
+    }
+  }
+
+  fprintf(stderr, "%li frames (%li key frames).\n", frames, keys);
+  return 0;
+}